@@ -41,9 +41,13 @@
 #include "iperf_server.h"
 
 #include <lwip/tcp.h>
+#include <lwip/udp.h>
 #include <lwip/debug.h>
 
+#include "config.h"
+
 #include <stdint.h>
+#include <string.h>
 
 #ifndef IPERF_DEBUG
 #define IPERF_DEBUG LWIP_DBG_ON
@@ -51,8 +55,48 @@
 
 extern unsigned long ticks;
 
+//A free running 32 bit counter and its frequency, used to time tests and
+//  measure UDP jitter. It's extended to 64 bits in software so it must be
+//  read at least once per wrap, which iperf_server_tmr takes care of. The
+//  default is only as fine as the ticks counter.
+#ifndef IPERF_CYCLES
+#define IPERF_CYCLES() ((uint32_t) ticks)
+#define IPERF_CYCLES_FREQ TICK_FREQ
+#endif
+
+//Print comma separated reports (like iperf -y C) instead of text
+#ifndef IPERF_CSV
+#define IPERF_CSV 0
+#endif
+
+//Sessions come from a fixed pool so parallel streams (iperf -P) don't
+//  fragment the heap. Each accepted connection takes one.
+#ifndef IPERF_MAX_SESSIONS
+#define IPERF_MAX_SESSIONS 4
+#endif
+
+//How often (in units of TCP_SLOW_INTERVAL) a sender is polled to restart
+//  transmission after running out of memory, and to end timed tests when
+//  no ACKs arrive
+#ifndef IPERF_TX_POLL
+#define IPERF_TX_POLL 1
+#endif
+
+//Buckets in the cwnd and in flight histograms of a sending stream, each
+//  one MSS wide with the last catching everything larger
+#ifndef IPERF_HIST_BUCKETS
+#define IPERF_HIST_BUCKETS 16
+#endif
+
+//A UDP test that hasn't received anything for this long (in ms) can be
+//  replaced by one from another client
+#ifndef IPERF_UDP_TIMEOUT
+#define IPERF_UDP_TIMEOUT 2000
+#endif
+
 static unsigned long send_data[TCP_MSS / sizeof(unsigned long)];
 
+#define HEADER_VERSION1 0x80000000
 #define RUN_NOW 0x00000001
 
 struct client_hdr {
@@ -64,22 +108,168 @@ struct client_hdr {
     int32_t mAmount;
 };
 
+//Starts every UDP datagram. The last one of a test has a negative id.
+struct udp_datagram {
+    int32_t id;
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+};
+
+//Sent back to the client, after a copy of its final datagram header
+struct server_hdr {
+    int32_t flags;
+    int32_t total_len1;
+    int32_t total_len2;
+    int32_t stop_sec;
+    int32_t stop_usec;
+    int32_t error_cnt;
+    int32_t outorder_cnt;
+    int32_t datagrams;
+    int32_t jitter1;
+    int32_t jitter2;
+};
+
+//One direction of a test. Running streams are kept in a list so the timer
+//  can print their interval reports.
+struct iperf_stream {
+    struct iperf_stream *next;
+    struct iperf_udp_state *udp;
+    struct tcp_samples *tcp;
+    struct iperf_group *group;
+    const char *dir;
+    int id;
+    ip_addr_t local_ip;
+    u16_t local_port;
+    ip_addr_t remote_ip;
+    u16_t remote_port;
+    uint64_t bytes;
+    uint64_t start;             //All times in microseconds
+    uint64_t end;
+    uint64_t last_report;
+    uint64_t last_bytes;
+    u32_t intervals;
+    uint64_t rate_min;          //Interval throughput in bits/sec
+    uint64_t rate_max;
+    uint64_t rate_sum;
+};
+
+//Parallel streams from one client test, also reported as a sum
+struct iperf_group {
+    struct iperf_stream sum;
+    int used;
+    int32_t threads;
+    int joined;
+    int active;
+    uint64_t done_bytes;        //From streams that already finished
+};
+
+//The pcb of a sending stream, sampled every time iperf_server_tmr runs.
+//  lwIP only measures the RTT of data it sends, in TCP_SLOW_INTERVAL units.
+struct tcp_samples {
+    struct tcp_pcb *pcb;
+    u32_t samples;
+    u32_t rtx;                  //Seen as increases in nrtx between samples
+    u32_t report_rtx;
+    u8_t last_nrtx;
+    u32_t cwnd_hist[IPERF_HIST_BUCKETS];
+    u32_t flight_hist[IPERF_HIST_BUCKETS];
+};
+
+//Extra columns printed for sending TCP streams
+struct tcp_report {
+    u32_t rtx;
+    u32_t cwnd;
+    u32_t snd_wnd;
+};
+
+//Extra columns printed for UDP streams
+struct udp_report {
+    u32_t jitter;
+    s32_t lost;
+    s32_t total;
+    s32_t out_of_order;
+};
+
+//The lost datagrams scaled by scale / total, in 64 bits so a long soak
+//  with many losses doesn't overflow
+static s32_t loss_pct(const struct udp_report *ur, int32_t scale)
+{
+    if (ur->total <= 0)
+        return 0;
+
+    return (s32_t) ((int64_t) ur->lost * scale / ur->total);
+}
+
+enum {
+    UDP_IDLE,
+    UDP_RECEIVING,
+    UDP_FINISHED,
+};
+
+static struct iperf_udp_state {
+    struct iperf_stream st;
+    struct udp_pcb *pcb;
+    int state;
+    unsigned long last_ticks;
+    s32_t first_id;
+    s32_t last_id;
+    s32_t lost;
+    s32_t out_of_order;
+    s32_t report_id;            //Counters at the last interval report
+    s32_t report_lost;
+    s32_t report_out_of_order;
+    u32_t last_transit;
+    u32_t jitter;               //In 1/16 microseconds, as in RFC 1889
+    struct udp_datagram fin;
+} udp_session;
+
 struct iperf_state {
+    int used;
     struct tcp_pcb *server_pcb;
     struct tcp_pcb *client_pcb;
-    unsigned long recv_bytes;
-    unsigned long sent_bytes;
-    unsigned long recv_start_ticks;
-    unsigned long recv_end_ticks;
-    unsigned long send_start_ticks;
-    unsigned long send_end_ticks;
+    struct iperf_stream rx;
+    struct iperf_stream tx;
     int32_t flags;
+    int32_t threads;
     int32_t amount;
     int valid_hdr;
+    uint64_t tx_queued;
+    u32_t stall_window;     //Data waiting on the send or congestion window
+    u32_t stall_sndbuf;     //All of TCP_SND_BUF waiting to be acknowledged
+    u32_t stall_queue;      //TCP_SND_QUEUELEN pbufs queued
+    u32_t stall_mem;        //tcp_write couldn't allocate a segment
+    struct tcp_samples tx_samples;
+};
+
+enum {
+    TX_STALL_NONE,
+    TX_STALL_SNDBUF,
+    TX_STALL_QUEUE,
+    TX_STALL_MEM,
 };
 
+static struct iperf_state sessions[IPERF_MAX_SESSIONS];
+static struct iperf_group groups[IPERF_MAX_SESSIONS];
+static struct iperf_stream *streams;
+static int next_stream_id = 3;
+static u32_t report_interval = IPERF_INTERVAL;
+static int report_csv = IPERF_CSV;
+
 static err_t disconnect(struct iperf_state *is, struct tcp_pcb *tpcb);
 
+static uint64_t usecs_now(void)
+{
+    static uint32_t last;
+    static uint64_t cycles;
+
+    uint32_t now = IPERF_CYCLES();
+    cycles += (uint32_t) (now - last);
+    last = now;
+
+    uint32_t freq = IPERF_CYCLES_FREQ;
+    return cycles / freq * 1000000 + cycles % freq * 1000000 / freq;
+}
+
 static void print_connection_msg(const char *id, struct tcp_pcb *tpcb)
 {
     LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
@@ -92,95 +282,571 @@ static void print_connection_msg(const char *id, struct tcp_pcb *tpcb)
                 (" port %d\n", tpcb->remote_port));
 }
 
-static const char * calc_prefix(unsigned long *val, int radix)
-{
-    if (*val > radix*radix*radix) {
-        *val /= radix;
-        *val *= 10;
-        *val /= radix;
-        *val /= radix;
-        return "G";
-    } else if (*val > radix*radix) {
-        *val /= radix;
-        *val *= 10;
-        *val /= radix;
-        return "M";
-    }  else if (*val > radix) {
-        *val *= 10;
-        *val /= radix;
-        return "K";
+//Picks the prefix for val and the divisor that goes with it
+static const char *calc_prefix(uint64_t val, int radix, uint64_t *div)
+{
+    static const char *prefixes[] = {"", "K", "M", "G", "T"};
+    int i = 0;
+
+    *div = 1;
+    while (i < 4 && val > *div * radix) {
+        *div *= radix;
+        i++;
     }
 
-    return "";
+    return prefixes[i];
+}
+
+//The value in tenths of div, for printing with one decimal place
+#define TENTHS(val, div) ((unsigned long) ((val) * 10 / (div)))
+
+//64 bit counters printed without relying on printf support for them
+static const char *u64_str(uint64_t val, char *buf, int len)
+{
+    char *s = buf + len - 1;
+
+    *s = 0;
+    do {
+        *--s = '0' + val % 10;
+        val /= 10;
+    } while (val && s > buf);
+
+    return s;
+}
+
+static uint64_t calc_rate(uint64_t bytes, uint64_t usecs)
+{
+    if (usecs == 0)
+        usecs = 1;
+
+    return bytes * 8 * 1000000 / usecs;
+}
+
+static void print_id(struct iperf_stream *st)
+{
+    if (st->id < 0)
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, ("iperf: [SUM]"));
+    else
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, ("iperf: [%3d]", st->id));
 }
 
-static void print_result(const char *id, unsigned long start_ticks,
-                         unsigned long end_ticks, unsigned long bytes)
+static void print_report(struct iperf_stream *st, uint64_t from, uint64_t to,
+                         uint64_t bytes, const struct udp_report *ur,
+                         const struct tcp_report *tr)
 {
-    unsigned long duration = end_ticks - start_ticks;
-    duration *= 10;
-    duration = (duration + TICK_FREQ/2) / TICK_FREQ;
+    uint64_t rate = calc_rate(bytes, to - from);
+    unsigned long from_tenths = (from + 50000) / 100000;
+    unsigned long to_tenths = (to + 50000) / 100000;
+
+    if (report_csv) {
+        char bytes_buf[21], rate_buf[21];
+        uint64_t now = usecs_now();
+
+        LWIP_PLATFORM_DIAG(("%lu.%03lu,%"U16_F".%"U16_F".%"U16_F".%"U16_F
+                            ",%"U16_F",%"U16_F".%"U16_F".%"U16_F".%"U16_F
+                            ",%"U16_F",%d,%lu.%lu-%lu.%lu,%s,%s",
+                 (unsigned long) (now / 1000000),
+                 (unsigned long) (now % 1000000 / 1000),
+                 ip4_addr1_16(&st->local_ip), ip4_addr2_16(&st->local_ip),
+                 ip4_addr3_16(&st->local_ip), ip4_addr4_16(&st->local_ip),
+                 st->local_port,
+                 ip4_addr1_16(&st->remote_ip), ip4_addr2_16(&st->remote_ip),
+                 ip4_addr3_16(&st->remote_ip), ip4_addr4_16(&st->remote_ip),
+                 st->remote_port, st->id,
+                 from_tenths / 10, from_tenths % 10,
+                 to_tenths / 10, to_tenths % 10,
+                 u64_str(bytes, bytes_buf, sizeof(bytes_buf)),
+                 u64_str(rate, rate_buf, sizeof(rate_buf))));
+
+        if (ur != NULL)
+            LWIP_PLATFORM_DIAG((",%"U32_F".%03"U32_F",%"S32_F",%"S32_F
+                                ",%"S32_F".%03"S32_F",%"S32_F,
+                     ur->jitter / 1000, ur->jitter % 1000, ur->lost, ur->total,
+                     loss_pct(ur, 100), loss_pct(ur, 100000) % 1000,
+                     ur->out_of_order));
 
-    unsigned long speed = bytes / duration * 8 * 10;
+        if (tr != NULL)
+            LWIP_PLATFORM_DIAG((",%"U32_F",%"U32_F",%"U32_F,
+                     tr->rtx, tr->cwnd, tr->snd_wnd));
 
-    const char *size_prefix = calc_prefix(&bytes, 1024);
-    const char *speed_prefix = calc_prefix(&speed, 1000);
+        LWIP_PLATFORM_DIAG(("\n"));
+        return;
+    }
+
+    uint64_t size_div, rate_div;
+    const char *size_prefix = calc_prefix(bytes, 1024, &size_div);
+    const char *rate_prefix = calc_prefix(rate, 1000, &rate_div);
 
+    print_id(st);
     LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
-                ("iperf: 0.0- %ld.%ld sec  %ld.%ld %sBytes  %ld.%ld %sbits/sec\n",
-                    duration / 10, duration % 10, bytes / 10, bytes % 10,
-                    size_prefix, speed / 10, speed % 10, speed_prefix));
+                (" %2lu.%lu-%2lu.%lu sec  %lu.%lu %sBytes  %lu.%lu %sbits/sec",
+                 from_tenths / 10, from_tenths % 10,
+                 to_tenths / 10, to_tenths % 10,
+                 TENTHS(bytes, size_div) / 10, TENTHS(bytes, size_div) % 10,
+                 size_prefix,
+                 TENTHS(rate, rate_div) / 10, TENTHS(rate, rate_div) % 10,
+                 rate_prefix));
+
+    if (ur != NULL)
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                    ("  %"U32_F".%03"U32_F" ms  %"S32_F"/%"S32_F" (%"S32_F
+                     "%%)", ur->jitter / 1000, ur->jitter % 1000,
+                     ur->lost, ur->total, loss_pct(ur, 100)));
+
+    if (tr != NULL)
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                    ("  rtx %"U32_F"  cwnd %"U32_F"K  wnd %"U32_F"K",
+                     tr->rtx, tr->cwnd / 1024, tr->snd_wnd / 1024));
+
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, ("\n"));
 }
 
-static void finish_send(struct iperf_state *is, struct tcp_pcb *tpcb)
+static void stream_init(struct iperf_stream *st, const char *dir,
+                        ip_addr_t *local_ip, u16_t local_port,
+                        ip_addr_t *remote_ip, u16_t remote_port)
 {
-    tcp_sent(tpcb, NULL);
-    is->send_end_ticks = ticks;
+    st->group = NULL;
+    st->dir = dir;
+    ip_addr_set(&st->local_ip, local_ip);
+    st->local_port = local_port;
+    ip_addr_set(&st->remote_ip, remote_ip);
+    st->remote_port = remote_port;
+    st->bytes = 0;
+    st->start = st->end = st->last_report = usecs_now();
+    st->last_bytes = 0;
+    st->intervals = 0;
+    st->rate_min = UINT64_MAX;
+    st->rate_max = 0;
+    st->rate_sum = 0;
+}
+
+static void stream_start(struct iperf_stream *st, const char *dir,
+                         ip_addr_t *local_ip, u16_t local_port,
+                         ip_addr_t *remote_ip, u16_t remote_port)
+{
+    stream_init(st, dir, local_ip, local_port, remote_ip, remote_port);
+    st->id = next_stream_id++;
+    st->next = streams;
+    streams = st;
+
+    if (!report_csv)
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                    ("iperf: [%3d] %s stream started\n", st->id, dir));
+}
+
+static struct udp_report *udp_interval(struct iperf_udp_state *us,
+                                       struct udp_report *ur);
+
+static int hist_bucket(u32_t val, u16_t mss)
+{
+    u32_t i = val / mss;
+    return i < IPERF_HIST_BUCKETS ? i : IPERF_HIST_BUCKETS - 1;
+}
+
+static void tcp_sample(struct tcp_samples *ts)
+{
+    struct tcp_pcb *pcb = ts->pcb;
+
+    if (pcb == NULL || pcb->mss == 0)
+        return;
+
+    //nrtx counts retransmits of the oldest segment and is reset by an ACK
+    if (pcb->nrtx > ts->last_nrtx)
+        ts->rtx += pcb->nrtx - ts->last_nrtx;
+    ts->last_nrtx = pcb->nrtx;
+
+    ts->cwnd_hist[hist_bucket(pcb->cwnd, pcb->mss)]++;
+    ts->flight_hist[hist_bucket(pcb->snd_nxt - pcb->lastack, pcb->mss)]++;
+    ts->samples++;
+}
+
+//lwIP keeps its RTT estimate (sa and sv) in TCP_SLOW_INTERVAL ticks, which
+//  on a LAN is always zero or a multiple of 500ms, so it isn't reported
+static struct tcp_report *tcp_report(struct tcp_samples *ts, u32_t rtx,
+                                     struct tcp_report *tr)
+{
+    struct tcp_pcb *pcb = ts->pcb;
+
+    if (pcb == NULL)
+        return NULL;
+
+    tr->rtx = rtx;
+    tr->cwnd = pcb->cwnd;
+    tr->snd_wnd = pcb->snd_wnd;
+
+    return tr;
+}
+
+static void print_hist(struct iperf_stream *st, const char *name,
+                       const u32_t *hist)
+{
+    print_id(st);
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, (" %s", name));
+
+    for (int i = 0; i < IPERF_HIST_BUCKETS; i++) {
+        if (hist[i])
+            LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                        (" %d%s:%"U32_F, i, i == IPERF_HIST_BUCKETS - 1 ?
+                         "+" : "", hist[i]));
+    }
+
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, ("\n"));
+}
+
+static void stream_interval(struct iperf_stream *st, uint64_t now)
+{
+    struct udp_report ur;
+    struct tcp_report tr;
+    struct tcp_report *trp = NULL;
+    uint64_t bytes = st->bytes - st->last_bytes;
+    uint64_t rate = calc_rate(bytes, now - st->last_report);
+
+    if (rate < st->rate_min)
+        st->rate_min = rate;
+    if (rate > st->rate_max)
+        st->rate_max = rate;
+    st->rate_sum += rate;
+    st->intervals++;
+
+    if (st->tcp != NULL) {
+        trp = tcp_report(st->tcp, st->tcp->rtx - st->tcp->report_rtx, &tr);
+        st->tcp->report_rtx = st->tcp->rtx;
+    }
+
+    print_report(st, st->last_report - st->start, now - st->start, bytes,
+                 st->udp ? udp_interval(st->udp, &ur) : NULL, trp);
+
+    st->last_report = now;
+    st->last_bytes = st->bytes;
+}
+
+static int stream_unlink(struct iperf_stream *st)
+{
+    for (struct iperf_stream **s = &streams; *s != NULL; s = &(*s)->next) {
+        if (*s == st) {
+            *s = st->next;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+//Final report, with the min/avg/max of the interval throughput
+static void stream_summary(struct iperf_stream *st,
+                           const struct udp_report *ur)
+{
+    //Report what's left of the last interval unless it's tiny
+    if (st->intervals && report_interval &&
+        st->end - st->last_report >= IPERF_TMR_INTERVAL * 1000)
+        stream_interval(st, st->end);
+
+    struct tcp_report tr;
+    print_report(st, 0, st->end - st->start, st->bytes, ur,
+                 st->tcp ? tcp_report(st->tcp, st->tcp->rtx, &tr) : NULL);
+
+    if (st->intervals == 0 || report_csv)
+        return;
+
+    uint64_t avg = st->rate_sum / st->intervals;
+    uint64_t div;
+    const char *prefix = calc_prefix(st->rate_max, 1000, &div);
+
+    print_id(st);
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                (" %s min/avg/max %lu.%lu/%lu.%lu/%lu.%lu "
+                 "%sbits/sec over %"U32_F" intervals\n", st->dir,
+                 TENTHS(st->rate_min, div) / 10, TENTHS(st->rate_min, div) % 10,
+                 TENTHS(avg, div) / 10, TENTHS(avg, div) % 10,
+                 TENTHS(st->rate_max, div) / 10, TENTHS(st->rate_max, div) % 10,
+                 prefix, st->intervals));
+}
+
+//Adds a stream to the group for its client test. The client sends the
+//  number of parallel streams in its header, and streams from the same
+//  address in the same direction fill up a group in the order they arrive.
+static void group_join(struct iperf_stream *st, int32_t threads)
+{
+    struct iperf_group *g, *free_group = NULL;
+
+    if (threads <= 1)
+        return;
+
+    for (g = groups; g < &groups[IPERF_MAX_SESSIONS]; g++) {
+        if (!g->used) {
+            if (free_group == NULL)
+                free_group = g;
+            continue;
+        }
+
+        if (g->threads == threads && g->joined < threads &&
+            g->sum.dir == st->dir &&
+            ip_addr_cmp(&g->sum.remote_ip, &st->remote_ip))
+            break;
+    }
+
+    if (g == &groups[IPERF_MAX_SESSIONS]) {
+        if ((g = free_group) == NULL)
+            return;
+
+        g->used = 1;
+        g->threads = threads;
+        g->joined = 0;
+        g->active = 0;
+        g->done_bytes = 0;
+        stream_init(&g->sum, st->dir, &st->local_ip, 0, &st->remote_ip, 0);
+        g->sum.id = -1;
+        g->sum.start = g->sum.end = g->sum.last_report = st->start;
+    }
+
+    st->group = g;
+    g->joined++;
+    g->active++;
+}
+
+static uint64_t group_bytes(struct iperf_group *g)
+{
+    uint64_t bytes = g->done_bytes;
+
+    for (struct iperf_stream *st = streams; st != NULL; st = st->next) {
+        if (st->group == g)
+            bytes += st->bytes;
+    }
+
+    return bytes;
+}
+
+//The sum is reported once the last stream of the group finishes
+static void group_leave(struct iperf_stream *st)
+{
+    struct iperf_group *g = st->group;
+
+    if (g == NULL)
+        return;
+
+    st->group = NULL;
+    g->done_bytes += st->bytes;
+    if (st->end > g->sum.end)
+        g->sum.end = st->end;
+
+    if (--g->active)
+        return;
+
+    g->used = 0;
+    if (g->joined > 1) {
+        g->sum.bytes = g->done_bytes;
+        stream_summary(&g->sum, NULL);
+    }
+}
+
+//Prints the final report of a running stream, if it was ever started
+static void stream_finish(struct iperf_stream *st,
+                          const struct udp_report *ur)
+{
+    if (!stream_unlink(st))
+        return;
+
+    stream_summary(st, ur);
+    group_leave(st);
+}
+
+static void finish_tx_stream(struct iperf_state *is, struct tcp_pcb *tpcb)
+{
+    struct tcp_samples *ts = &is->tx_samples;
+
+    //The pcb is already gone after an error
+    ts->pcb = tpcb;
+    if (tpcb != NULL)
+        tcp_sample(ts);
+
+    is->tx.end = usecs_now();
+    stream_finish(&is->tx, NULL);
+    ts->pcb = NULL;
+
+    //Nothing to say if it never connected
+    if (is->tx.id == 0 || report_csv)
+        return;
+
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                ("iperf: [%3d] tx stalls: window %"U32_F"  sndbuf %"U32_F
+                 "  queue %"U32_F"  memory %"U32_F"\n", is->tx.id,
+                 is->stall_window, is->stall_sndbuf, is->stall_queue,
+                 is->stall_mem));
+
+    if (ts->samples == 0)
+        return;
+
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                ("iperf: [%3d] tx retransmits %"U32_F", %"U32_F
+                 " samples in MSS:\n", is->tx.id, ts->rtx, ts->samples));
+    print_hist(&is->tx, "cwnd     ", ts->cwnd_hist);
+    print_hist(&is->tx, "in flight", ts->flight_hist);
+}
+
+static err_t finish_send(struct iperf_state *is, struct tcp_pcb *tpcb)
+{
+    finish_tx_stream(is, tpcb);
+
+    return disconnect(is, tpcb);
+}
+
+//A negative amount is the test time in hundredths of a second
+static int tx_done(struct iperf_state *is)
+{
+    if (is->amount > 0)
+        return is->tx.bytes >= is->amount;
+
+    return usecs_now() - is->tx.start > (uint64_t) -is->amount * 10000;
+}
+
+//Queues segments until the connection won't take any more, then sends
+//  them. The limit that stopped it is counted to show what held the sender
+//  back.
+static void tx_fill(struct iperf_state *is, struct tcp_pcb *tpcb)
+{
+    int stall = TX_STALL_NONE;
+    int queued = 0;
+
+    for (;;) {
+        u16_t len = sizeof(send_data);
+
+        //Don't queue more than was asked for
+        if (is->amount > 0) {
+            if (is->tx_queued >= is->amount)
+                break;
+            if (is->amount - is->tx_queued < len)
+                len = is->amount - is->tx_queued;
+        }
+
+        if (tcp_sndbuf(tpcb) < len) {
+            stall = TX_STALL_SNDBUF;
+            break;
+        }
+
+        //Each write needs a header pbuf as well as one for the data
+        if (tcp_sndqueuelen(tpcb) + 2 > TCP_SND_QUEUELEN) {
+            stall = TX_STALL_QUEUE;
+            break;
+        }
 
-    print_result("tx", is->send_start_ticks, is->send_end_ticks,
-                 is->sent_bytes);
+        err_t err = tcp_write(tpcb, send_data, len, TCP_WRITE_FLAG_MORE);
+        if (err == ERR_MEM) {
+            stall = TX_STALL_MEM;
+            break;
+        } else if (err != ERR_OK) {
+            break;
+        }
 
-    disconnect(is, tpcb);
+        is->tx_queued += len;
+        queued = 1;
+    }
+
+    if (queued)
+        tcp_output(tpcb);
 
+    switch (stall) {
+    case TX_STALL_SNDBUF:
+        //Anything still unsent after tcp_output is waiting on the window
+        if (tpcb->unsent != NULL)
+            is->stall_window++;
+        else
+            is->stall_sndbuf++;
+        break;
+    case TX_STALL_QUEUE:
+        is->stall_queue++;
+        break;
+    case TX_STALL_MEM:
+        is->stall_mem++;
+        break;
+    }
 }
 
 static err_t sent(void *arg, struct tcp_pcb *tpcb, u16_t len)
 {
     struct iperf_state *is = (struct iperf_state *) arg;
 
-    is->sent_bytes += len;
-
-    if (is->amount > 0 && is->sent_bytes > is->amount) {
-        finish_send(is, tpcb);
+    if (is == NULL)
         return ERR_OK;
-    } else if (is->amount < 0 && (ticks-is->send_start_ticks) > -is->amount) {
-        finish_send(is, tpcb);
+
+    is->tx.bytes += len;
+
+    if (tx_done(is))
+        return finish_send(is, tpcb);
+
+    tx_fill(is, tpcb);
+
+    return ERR_OK;
+}
+
+//The reverse connection only sends, but the client half-closes it once
+//  its side is done. Without a receive callback lwIP's default closes the
+//  pcb and frees it after LAST_ACK without calling the error callback, so
+//  the stream would be left sampling a freed pcb and the session never
+//  released.
+static err_t tx_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p,
+                     err_t err)
+{
+    struct iperf_state *is = (struct iperf_state *) arg;
+
+    if (p != NULL) {
+        tcp_recved(tpcb, p->tot_len);
+        pbuf_free(p);
         return ERR_OK;
     }
 
-    int space;
-    while ((space = tcp_sndbuf(tpcb)) >= sizeof(send_data)) {
-        tcp_write(tpcb, send_data, sizeof(send_data), 0);
-    }
+    if (is == NULL)
+        return ERR_OK;
 
-    return ERR_OK;
+    return finish_send(is, tpcb);
+}
+
+//Without anything in flight there won't be an ACK to call sent
+static err_t tx_poll(void *arg, struct tcp_pcb *tpcb)
+{
+    return sent(arg, tpcb, 0);
 }
 
 static err_t connected(void *arg, struct tcp_pcb *tpcb, err_t err)
 {
     struct iperf_state *is = (struct iperf_state *) arg;
 
+    if (is == NULL)
+        return ERR_OK;
+
     print_connection_msg("tx", tpcb);
+    stream_start(&is->tx, "tx", &tpcb->local_ip, tpcb->local_port,
+                 &tpcb->remote_ip, tpcb->remote_port);
+    group_join(&is->tx, is->threads);
+    is->tx_samples.pcb = tpcb;
+    is->tx.tcp = &is->tx_samples;
     tcp_sent(tpcb, sent);
-    sent(is, tpcb, 0);
+    tcp_poll(tpcb, tx_poll, IPERF_TX_POLL);
 
-    return ERR_OK;
+    return sent(is, tpcb, 0);
 }
 
 static void connect_error(void *arg, err_t err)
 {
     struct iperf_state *is = (struct iperf_state *) arg;
+
+    if (is == NULL)
+        return;
+
     is->client_pcb = NULL;
+    finish_tx_stream(is, NULL);
+    disconnect(is, NULL);
+}
+
+static void server_error(void *arg, err_t err)
+{
+    struct iperf_state *is = (struct iperf_state *) arg;
+
+    if (is == NULL)
+        return;
+
+    is->server_pcb = NULL;
+    is->rx.end = usecs_now();
+    stream_finish(&is->rx, NULL);
     disconnect(is, NULL);
 }
 
@@ -190,26 +856,45 @@ static void reverse_connect(struct iperf_state *is, struct ip_addr *remote_ip)
     if (is->client_pcb != NULL) {
         tcp_arg(is->client_pcb, is);
         tcp_err(is->client_pcb, connect_error);
+        tcp_recv(is->client_pcb, tx_recv);
         tcp_connect(is->client_pcb, remote_ip, IPERF_SERVER_PORT,
                     connected);
     }
+}
 
-    is->send_start_ticks = ticks;
+//lwIP keeps a closed pcb around until the FIN handshake completes, and the
+//  session it points at may be reused from the pool by then, so nothing
+//  may call back into it
+static void detach(struct tcp_pcb *tpcb)
+{
+    tcp_arg(tpcb, NULL);
+    tcp_err(tpcb, NULL);
+    tcp_recv(tpcb, NULL);
+    tcp_sent(tpcb, NULL);
+    tcp_poll(tpcb, NULL, 0);
 }
 
 static err_t disconnect(struct iperf_state *is, struct tcp_pcb *tpcb)
 {
-    err_t ret;
+    err_t ret = ERR_OK;
+    ip_addr_t remote_ip;
 
-    if (tpcb != NULL && (ret = tcp_close(tpcb)) != ERR_OK)
-        return ret;
+    if (tpcb != NULL) {
+        ip_addr_copy(remote_ip, tpcb->remote_ip);
+        detach(tpcb);
+
+        //Without callbacks a failed close would never be retried
+        if (tcp_close(tpcb) != ERR_OK) {
+            tcp_abort(tpcb);
+            ret = ERR_ABRT;
+        }
+    }
 
     if (tpcb != NULL && is->server_pcb == tpcb) {
         if (is->client_pcb == NULL && !(is->flags & RUN_NOW))
-            reverse_connect(is, &tpcb->remote_ip);
+            reverse_connect(is, &remote_ip);
 
-        print_result("rx", is->recv_start_ticks, is->recv_end_ticks,
-                     is->recv_bytes);
+        stream_finish(&is->rx, NULL);
 
         is->server_pcb = NULL;
     }
@@ -218,24 +903,26 @@ static err_t disconnect(struct iperf_state *is, struct tcp_pcb *tpcb)
         is->client_pcb = NULL;
 
     if (is->client_pcb == NULL && is->server_pcb == NULL) {
-        mem_free(is);
+        stream_unlink(&is->rx);
+        stream_unlink(&is->tx);
+        group_leave(&is->rx);
+        group_leave(&is->tx);
+        is->used = 0;
     }
 
-    return ERR_OK;
+    return ret;
 }
 
 static void parse_header(struct iperf_state *is, struct tcp_pcb *tpcb, void *data)
 {
     struct client_hdr *chdr = (struct client_hdr *) data;
     is->flags = ntohl(chdr->flags);
+    is->threads = ntohl(chdr->numThreads);
     is->amount = ntohl(chdr->mAmount);
-
-    is->amount *= TICK_FREQ;
-    is->amount /= 100;
-
-    is->recv_start_ticks = ticks;
     is->valid_hdr = 1;
 
+    group_join(&is->rx, is->threads);
+
     if (is->flags & RUN_NOW)
         reverse_connect(is, &tpcb->remote_ip);
 }
@@ -244,40 +931,288 @@ static err_t recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 {
     struct iperf_state *is = (struct iperf_state *) arg;
 
+    if (is == NULL) {
+        if (p != NULL) {
+            tcp_recved(tpcb, p->tot_len);
+            pbuf_free(p);
+        }
+        return ERR_OK;
+    }
+
     if (p == NULL) {
-        is->recv_end_ticks = ticks;
+        is->rx.end = usecs_now();
         return disconnect(is, tpcb);
     }
 
     if (!is->valid_hdr)
         parse_header(is, tpcb, p->payload);
 
-    is->recv_bytes += p->tot_len;
+    is->rx.bytes += p->tot_len;
     tcp_recved(tpcb, p->tot_len);
     pbuf_free(p);
 
     return ERR_OK;
 }
 
+static struct iperf_state *session_alloc(void)
+{
+    for (int i = 0; i < IPERF_MAX_SESSIONS; i++) {
+        if (!sessions[i].used) {
+            memset(&sessions[i], 0, sizeof(sessions[i]));
+            sessions[i].used = 1;
+            return &sessions[i];
+        }
+    }
+
+    return NULL;
+}
+
 static err_t accept(void *arg, struct tcp_pcb *newpcb, err_t err)
 {
     print_connection_msg("rx", newpcb);
 
-    struct iperf_state *is = mem_malloc(sizeof(struct iperf_state));
-    if (is == NULL)
+    struct iperf_state *is = session_alloc();
+    if (is == NULL) {
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                    ("iperf: no free sessions\n"));
         return ERR_MEM;
+    }
 
     is->server_pcb = newpcb;
-    is->client_pcb = NULL;
-    is->valid_hdr = 0;
-    is->recv_bytes = 0;
-    is->sent_bytes = 0;
+    stream_start(&is->rx, "rx", &newpcb->local_ip, newpcb->local_port,
+                 &newpcb->remote_ip, newpcb->remote_port);
 
     tcp_arg(newpcb, is);
+    tcp_err(newpcb, server_error);
     tcp_recv(newpcb, recv);
     return ERR_OK;
 }
 
+static void udp_start(struct iperf_udp_state *us, ip_addr_t *addr, u16_t port,
+                      struct udp_datagram *dgram, struct pbuf *p)
+{
+    //An unfinished test being replaced still gets its report
+    if (us->state == UDP_RECEIVING) {
+        us->st.end = usecs_now();
+        stream_finish(&us->st, NULL);
+    }
+
+    us->state = UDP_RECEIVING;
+    us->first_id = (int32_t) ntohl(dgram->id);
+    us->last_id = us->first_id - 1;
+    us->lost = 0;
+    us->out_of_order = 0;
+    us->report_id = us->last_id;
+    us->report_lost = 0;
+    us->report_out_of_order = 0;
+    us->jitter = 0;
+
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, ("iperf: [udp] rem "));
+    ip_addr_debug_print(IPERF_DEBUG | LWIP_DBG_STATE, addr);
+    LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE, (" port %d\n", port));
+
+    us->st.udp = us;
+    stream_start(&us->st, "udp", &us->pcb->local_ip, us->pcb->local_port,
+                 addr, port);
+
+    //The client header follows the first datagram
+    struct client_hdr chdr;
+    if (pbuf_copy_partial(p, &chdr, sizeof(chdr), sizeof(*dgram)) ==
+        sizeof(chdr) && (ntohl(chdr.flags) & HEADER_VERSION1))
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                    ("iperf: [udp] tradeoff and dual tests not supported\n"));
+}
+
+static void udp_account(struct iperf_udp_state *us, s32_t id, u32_t transit,
+                        int len)
+{
+    us->st.bytes += len;
+
+    //J = J + (|D(i-1,i)| - J) / 16, scaled by 16 to keep the fraction
+    if (id != us->first_id) {
+        s32_t d = transit - us->last_transit;
+        if (d < 0)
+            d = -d;
+        us->jitter += d - ((us->jitter + 8) >> 4);
+    }
+    us->last_transit = transit;
+
+    //A gap counts the missing datagrams as lost until they turn up late
+    if (id != us->last_id + 1) {
+        if (id < us->last_id + 1)
+            us->out_of_order++;
+        else
+            us->lost += id - us->last_id - 1;
+    }
+
+    if (id > us->last_id)
+        us->last_id = id;
+}
+
+//Fills in the UDP columns for the datagrams since the last report
+static struct udp_report *udp_interval(struct iperf_udp_state *us,
+                                       struct udp_report *ur)
+{
+    ur->jitter = us->jitter >> 4;
+    ur->total = us->last_id - us->report_id;
+    ur->out_of_order = us->out_of_order - us->report_out_of_order;
+    ur->lost = us->lost - us->report_lost - ur->out_of_order;
+    if (ur->lost < 0)
+        ur->lost = 0;
+
+    us->report_id = us->last_id;
+    us->report_lost = us->lost;
+    us->report_out_of_order = us->out_of_order;
+
+    return ur;
+}
+
+static void udp_send_report(struct iperf_udp_state *us)
+{
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(struct udp_datagram) +
+                                sizeof(struct server_hdr), PBUF_RAM);
+    if (p == NULL)
+        return;
+
+    struct udp_datagram *dgram = p->payload;
+    struct server_hdr *hdr = (struct server_hdr *) (dgram + 1);
+    uint64_t duration = us->st.end - us->st.start;
+    u32_t jitter = us->jitter >> 4;
+    s32_t lost = us->lost - us->out_of_order;
+
+    *dgram = us->fin;
+    hdr->flags = htonl(HEADER_VERSION1);
+    hdr->total_len1 = htonl((u32_t) (us->st.bytes >> 32));
+    hdr->total_len2 = htonl((u32_t) us->st.bytes);
+    hdr->stop_sec = htonl((u32_t) (duration / 1000000));
+    hdr->stop_usec = htonl((u32_t) (duration % 1000000));
+    hdr->error_cnt = htonl(lost > 0 ? lost : 0);
+    hdr->outorder_cnt = htonl(us->out_of_order);
+    hdr->datagrams = htonl(us->last_id - us->first_id + 1);
+    hdr->jitter1 = htonl(jitter / 1000000);
+    hdr->jitter2 = htonl(jitter % 1000000);
+
+    udp_sendto(us->pcb, p, &us->st.remote_ip, us->st.remote_port);
+    pbuf_free(p);
+}
+
+static void udp_finish(struct iperf_udp_state *us)
+{
+    struct udp_report ur;
+
+    us->state = UDP_FINISHED;
+    us->st.end = usecs_now();
+
+    ur.jitter = us->jitter >> 4;
+    ur.total = us->last_id - us->first_id + 1;
+    ur.out_of_order = us->out_of_order;
+    ur.lost = us->lost - us->out_of_order;
+    if (ur.lost < 0)
+        ur.lost = 0;
+
+    stream_finish(&us->st, &ur);
+
+    if (!report_csv)
+        LWIP_DEBUGF(IPERF_DEBUG | LWIP_DBG_STATE,
+                    ("iperf: [%3d] %"S32_F" datagrams received out of order\n",
+                     us->st.id, us->out_of_order));
+}
+
+static void udp_received(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                         ip_addr_t *addr, u16_t port)
+{
+    struct iperf_udp_state *us = (struct iperf_udp_state *) arg;
+    u32_t now = (u32_t) usecs_now();
+    struct udp_datagram dgram;
+
+    if (pbuf_copy_partial(p, &dgram, sizeof(dgram), 0) != sizeof(dgram)) {
+        pbuf_free(p);
+        return;
+    }
+
+    s32_t id = (int32_t) ntohl(dgram.id);
+    int same_client = (us->state != UDP_IDLE && us->st.remote_port == port &&
+                       ip_addr_cmp(&us->st.remote_ip, addr));
+
+    if (!same_client) {
+        //Only one UDP test runs at a time, and stray final datagrams
+        //  from an old test are ignored
+        if (id < 0 || (us->state == UDP_RECEIVING &&
+                       (ticks - us->last_ticks) * (1000 / TICK_FREQ) <
+                       IPERF_UDP_TIMEOUT))
+        {
+            pbuf_free(p);
+            return;
+        }
+
+        udp_start(us, addr, port, &dgram, p);
+    } else if (us->state == UDP_FINISHED) {
+        //The client repeats its final datagram until it gets the report
+        if (id < 0)
+            udp_send_report(us);
+        else
+            udp_start(us, addr, port, &dgram, p);
+
+        if (id < 0) {
+            pbuf_free(p);
+            return;
+        }
+    }
+
+    us->last_ticks = ticks;
+
+    //The transit time includes the offset between the two clocks, which
+    //  cancels out in the difference between consecutive datagrams
+    u32_t sent = ntohl(dgram.tv_sec) * 1000000 + ntohl(dgram.tv_usec);
+    udp_account(us, id < 0 ? -id : id, now - sent, p->tot_len);
+
+    if (id < 0) {
+        us->fin = dgram;
+        udp_finish(us);
+        udp_send_report(us);
+    }
+
+    pbuf_free(p);
+}
+
+void iperf_server_tmr(void)
+{
+    //Keeps the extended counter from missing a wrap between tests
+    uint64_t now = usecs_now();
+
+    for (struct iperf_stream *st = streams; st != NULL; st = st->next) {
+        if (st->tcp != NULL)
+            tcp_sample(st->tcp);
+    }
+
+    if (report_interval == 0)
+        return;
+
+    for (struct iperf_stream *st = streams; st != NULL; st = st->next) {
+        if (now - st->last_report >= (uint64_t) report_interval * 1000)
+            stream_interval(st, now);
+    }
+
+    for (struct iperf_group *g = groups; g < &groups[IPERF_MAX_SESSIONS]; g++) {
+        if (g->used && g->joined > 1 &&
+            now - g->sum.last_report >= (uint64_t) report_interval * 1000)
+        {
+            g->sum.bytes = group_bytes(g);
+            stream_interval(&g->sum, now);
+        }
+    }
+}
+
+void iperf_server_set_interval(u32_t ms)
+{
+    report_interval = ms;
+}
+
+void iperf_server_set_csv(int enable)
+{
+    report_csv = enable;
+}
+
 err_t iperf_server_init(void)
 {
     err_t ret = ERR_OK;
@@ -299,5 +1234,18 @@ err_t iperf_server_init(void)
     pcb = tcp_listen(pcb);
     tcp_accept(pcb, accept);
 
+    udp_session.pcb = udp_new();
+    if (udp_session.pcb == NULL)
+        return ERR_MEM;
+
+    if ((ret = udp_bind(udp_session.pcb, IP_ADDR_ANY,
+                        IPERF_SERVER_PORT)) != ERR_OK)
+    {
+        udp_remove(udp_session.pcb);
+        return ret;
+    }
+
+    udp_recv(udp_session.pcb, udp_received, &udp_session);
+
     return ret;
 }
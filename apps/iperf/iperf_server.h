@@ -48,7 +48,20 @@
 #define IPERF_SERVER_PORT 5001
 #endif
 
+//Interval (in ms) at which iperf_server_tmr should be called
+#ifndef IPERF_TMR_INTERVAL
+#define IPERF_TMR_INTERVAL 100
+#endif
+
+//Print a report for every running stream this often (in ms), like
+//  iperf -i. Zero only reports at the end of each test.
+#ifndef IPERF_INTERVAL
+#define IPERF_INTERVAL 0
+#endif
 
 err_t iperf_server_init(void);
+void iperf_server_tmr(void);
+void iperf_server_set_interval(u32_t ms);
+void iperf_server_set_csv(int enable);
 
 #endif
@@ -51,7 +51,15 @@
 #define MEMP_NUM_PBUF 32
 #define MEMP_NUM_TCP_PCB 10
 
-#define PBUF_POOL_SIZE 32
+//The stif driver receives into its own buffer pool (see STIF_RX_POOL_SIZE)
+//  so the LWIP pbuf pool is hardly used.
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+#define PBUF_POOL_SIZE 4
+#define STIF_RX_POOL_SIZE 20
+#define STIF_IRQ_MODERATION STIF_IRQ_MODERATION_ADAPTIVE
+
+//The packet generator's CPU headroom needs the per-stage cycle counts
+#define STIF_CYCLE_STATS 1
 
 //Checksum handled by hardware
 #define CHECKSUM_GEN_IP     0
@@ -83,6 +91,13 @@
 #include <stmlib/rand.h>
 #define LWIP_RAND    rand_value
 
+//Time iperf tests with the core's cycle counter (enabled by stif) and
+//  report every second
+#include <stmlib/clock.h>
+#define IPERF_CYCLES()     (DWT->CYCCNT)
+#define IPERF_CYCLES_FREQ  clock_get_freq(NULL)
+#define IPERF_INTERVAL     1000
+
 #define LWIP_STATS         1
 #define LWIP_STATS_DISPLAY 1
 
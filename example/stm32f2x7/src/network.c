@@ -53,6 +53,7 @@
 
 #include <netif/etharp.h>
 #include <netif/stif.h>
+#include <netif/stif_pktgen.h>
 
 #include <iperf/iperf_server.h>
 #include <mdns/mdns_responder.h>
@@ -152,6 +153,26 @@ void network_init(void)
     echo_init();
 }
 
+#if LWIP_STATS_DISPLAY
+static void pktgen_toggle(void)
+{
+    //A one second loopback test at line rate for full sized frames
+    static const struct stif_pktgen_config cfg = {
+        .size = 1514,
+        .rate = 8127,
+        .count = 8127,
+        .loopback = 1,
+    };
+
+    if (stif_pktgen_running()) {
+        stif_pktgen_stop();
+        stif_pktgen_display();
+    } else if (stif_pktgen_start(&netif, &cfg) == ERR_OK) {
+        printf("Packet generator started.\n");
+    }
+}
+#endif
+
 static inline int check_timer(void (*tmr_func)(), unsigned long *timer,
                               unsigned long ticks,
                               unsigned long interval)
@@ -172,29 +193,48 @@ int network_loop(unsigned long ticks)
     static unsigned long dhcp_coarse_timer = 0;
     static unsigned long dhcp_fine_timer = 0;
     static unsigned long autoip_timer = 0;
+    static unsigned long stif_timer = 0;
+    static unsigned long iperf_timer = 0;
 
     int ret = stif_loop(&netif);
+    ret += stif_pktgen_poll();
 
+    //Frames the timers send are only handed to the DMA by the next
+    //  stif_loop call, so don't sleep before it has run
     if (check_timer(etharp_tmr, &etharp_timer, ticks, ARP_TMR_INTERVAL))
-        return ret;
+        return 1;
 
     if (check_timer(tcp_tmr, &tcp_timer, ticks, TCP_TMR_INTERVAL))
-        return ret;
+        return 1;
 
     if (check_timer(autoip_tmr, &autoip_timer, ticks, AUTOIP_TMR_INTERVAL))
-        return ret;
+        return 1;
+
+    if (check_timer(stif_tmr, &stif_timer, ticks, STIF_TMR_INTERVAL))
+        return 1;
+
+    if (check_timer(iperf_server_tmr, &iperf_timer, ticks,
+                    IPERF_TMR_INTERVAL))
+        return 1;
 
     if (check_timer(dhcp_coarse_tmr, &dhcp_coarse_timer, ticks,
                     DHCP_COARSE_TIMER_MSECS))
-        return ret;
+        return 1;
 
     if (check_timer(dhcp_fine_tmr, &dhcp_fine_timer, ticks,
                     DHCP_FINE_TIMER_MSECS))
-        return ret;
+        return 1;
 
     #if LWIP_STATS_DISPLAY
-    if (debug_getchar() == 's')
+    int c = debug_getchar();
+    if (c == 's')
         stats_display();
+    else if (c == 'n') {
+        stif_stats_display();
+        stif_pktgen_display();
+    }
+    else if (c == 'g')
+        pktgen_toggle();
     #endif
 
     return ret;
@@ -89,10 +89,15 @@
 #define PHY_BSR_FULLDPLX             (PHY_BSR_100BASETX_FULLDPLX | \
                                       PHY_BSR_10BASET_FULLDPLX)
 
+#define PHY_AUTO_NEG_AD_ASYM_PAUSE   (1 << 11)
+#define PHY_AUTO_NEG_AD_PAUSE        (1 << 10)
+
 #define PHY_LINK_PARTNER_NEXT_PAGE            (1 << 15)
 #define PHY_LINK_PARTNER_ACK                  (1 << 14)
 #define PHY_LINK_PARTNER_REMOTE_FAULT         (1 << 13)
-#define PHY_LINK_PARTNER_PAUSE                (3 << 11)
+#define PHY_LINK_PARTNER_PAUSE                (3 << 10)
+#define PHY_LINK_PARTNER_ASYM_PAUSE           (1 << 11)
+#define PHY_LINK_PARTNER_SYM_PAUSE            (1 << 10)
 #define PHY_LINK_PARTNER_100BASET4            (1 << 9)
 #define PHY_LINK_PARTNER_100BASETX_FULLDPLX   (1 << 8)
 #define PHY_LINK_PARTNER_100BASETX_HALFDPLX   (1 << 7)
@@ -42,6 +42,7 @@
 #include "lwip/mem.h"
 #include "netif/etharp.h"
 #include "lwip/igmp.h"
+#include "lwip/ip.h"
 #include "stif.h"
 #include "stif_dma.h"
 
@@ -56,13 +57,389 @@
 #define STIF_NUM_TX_DMA_DESC 20
 #endif
 static struct dma_desc tx_dma_desc[STIF_NUM_TX_DMA_DESC];
+
+//In ring mode each transmit descriptor carries two segments of a pbuf
+//  chain (buffers 1 and 2) instead of one, so a typical TCP segment
+//  (headers plus payload) only takes a single descriptor.
+#ifndef STIF_TX_RING_MODE
+#define STIF_TX_RING_MODE 0
+#endif
+
+#if STIF_TX_RING_MODE
+#define TX_SEGS_PER_DESC 2
+#else
+#define TX_SEGS_PER_DESC 1
+#endif
+
+//Chains that would need more descriptors than this are copied into a
+//  single bounce buffer rather than tying up (or never fitting) the ring
+#ifndef STIF_TX_MAX_FRAME_DESCS
+#define STIF_TX_MAX_FRAME_DESCS 4
+#endif
+
 static struct dma_desc *tx_cur_dma_desc;
+static struct dma_desc *tx_clean_dma_desc;
+static int tx_free_descs;
+static int tx_kick_pending;
+static u32_t tx_cleaned;
+
+//The DMA is assumed to have stalled if it owns descriptors but hasn't
+//  finished any of them for this long (in ms)
+#ifndef STIF_TX_TIMEOUT
+#define STIF_TX_TIMEOUT 500
+#endif
+
+//Frames that can't go straight into the ring wait in a queue per
+//  priority class. Classes other than STIF_TX_CLASS_CONTROL may only fill
+//  STIF_TX_LOW_PRIO_DESCS descriptors so control frames never sit behind
+//  a whole ring of bulk data.
+#ifndef STIF_TX_QUEUE_LEN
+#define STIF_TX_QUEUE_LEN 8
+#endif
+
+#ifndef STIF_TX_LOW_PRIO_DESCS
+#define STIF_TX_LOW_PRIO_DESCS (STIF_NUM_TX_DMA_DESC * 3 / 4)
+#endif
+
+//IP frames with a DSCP of at least STIF_TX_DSCP_CONTROL (CS6 and CS7 by
+//  default) are control traffic and CS1 (scavenger) is bulk.
+#ifndef STIF_TX_DSCP_CONTROL
+#define STIF_TX_DSCP_CONTROL 48
+#endif
+
+#ifndef STIF_TX_DSCP_BULK
+#define STIF_TX_DSCP_BULK 8
+#endif
+
+#ifndef STIF_TX_PORT_RULES
+#define STIF_TX_PORT_RULES 8
+#endif
+
+static struct tx_queue {
+    struct pbuf *p[STIF_TX_QUEUE_LEN];
+    uint32_t stamp[STIF_TX_QUEUE_LEN];
+    int head;
+    int count;
+
+    //Token bucket, a rate of zero is unlimited
+    u32_t rate;
+    u32_t per_cycle;
+    u32_t burst;
+    s32_t tokens;
+    uint32_t last_fill;
+} tx_queues[STIF_TX_CLASSES];
+
+//UDP destination ports with their own class (a port of zero is unused)
+static struct {
+    u16_t port;
+    u8_t cls;
+} tx_port_class[STIF_TX_PORT_RULES] = {
+    {5353, STIF_TX_CLASS_CONTROL},  //mDNS
+    {67, STIF_TX_CLASS_CONTROL},    //DHCP
+    {68, STIF_TX_CLASS_CONTROL},
+};
+
+//Frames for raw L2 protocols can be handed to a handler registered for
+//  their ethertype and/or destination address, skipping LWIP entirely.
+#ifndef STIF_RX_HANDLERS
+#define STIF_RX_HANDLERS 4
+#endif
+
+static struct rx_handler {
+    stif_rx_handler_fn fn;
+    void *arg;
+    u16_t ethtype;          //Zero matches any
+    u8_t match_dst;
+    u8_t dst[ETHARP_HWADDR_LEN];
+} rx_handlers[STIF_RX_HANDLERS];
+static int rx_num_handlers;
+
+//Broadcast and multicast frames that don't match a receive rule are
+//  limited to this many per second. Zero, the default, leaves them unlimited
+//  until the application opts in with stif_set_rx_storm_rate.
+#ifndef STIF_RX_STORM_RATE
+#define STIF_RX_STORM_RATE 0
+#endif
+
+#ifndef STIF_RX_STORM_BURST
+#define STIF_RX_STORM_BURST 100
+#endif
+
+struct rx_policer {
+    u32_t rate;
+    u32_t per_cycle;
+    u32_t burst;
+    s32_t tokens;
+    uint32_t last_fill;
+};
+
+static struct rx_rule {
+    struct stif_rx_rule rule;
+    struct rx_policer pol;
+} rx_rules[STIF_RX_RULES];
+static int rx_num_rules;
+static struct rx_policer rx_storm;
 
 #ifndef STIF_NUM_RX_DMA_DESC
 #define STIF_NUM_RX_DMA_DESC 5
 #endif
 static struct dma_desc rx_dma_desc[STIF_NUM_RX_DMA_DESC];
 static struct dma_desc *rx_cur_dma_desc;
+static struct dma_desc *rx_refill_dma_desc;
+
+//Set while reception is starved, from when the DMA runs out of armed
+//  descriptors (or is restarted) until every descriptor is armed again.
+static int rx_recovering;
+static uint32_t rx_recovery_start;
+
+//Set by the interrupt handler when the DMA reports a fatal bus error
+static volatile int dma_error;
+
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "stif requires LWIP_SUPPORT_CUSTOM_PBUF for its receive buffers"
+#endif
+
+//In split mode the receive descriptors are used in ring mode and each
+//  one carries a small buffer (for short frames and headers) plus a large
+//  buffer which is only consumed by the remainder of long frames.
+#ifndef STIF_RX_SPLIT_BUFFERS
+#define STIF_RX_SPLIT_BUFFERS 0
+#endif
+
+#if STIF_RX_SPLIT_BUFFERS
+#ifndef STIF_RX_SMALL_BUF_SIZE
+#define STIF_RX_SMALL_BUF_SIZE 256
+#endif
+
+#ifndef STIF_RX_SMALL_POOL_SIZE
+#define STIF_RX_SMALL_POOL_SIZE (2*STIF_NUM_RX_DMA_DESC)
+#endif
+
+#ifndef STIF_RX_BUF_SIZE
+#define STIF_RX_BUF_SIZE (1524 - STIF_RX_SMALL_BUF_SIZE)
+#endif
+
+#define RX_DESC_BUF_SIZE (STIF_RX_SMALL_BUF_SIZE + STIF_RX_BUF_SIZE)
+#endif
+
+//In harvest mode the interrupt handler takes completed descriptors off
+//  the ring and re-arms them with spare buffers prepared by stif_loop, so
+//  a main loop that's busy elsewhere doesn't leave the DMA without
+//  descriptors. The frames wait for stif_loop in a queue of
+//  STIF_RX_HARVEST_LEN entries instead.
+#ifndef STIF_RX_ISR_HARVEST
+#define STIF_RX_ISR_HARVEST 0
+#endif
+
+#if STIF_RX_ISR_HARVEST
+#if STIF_RX_SPLIT_BUFFERS
+#error "STIF_RX_ISR_HARVEST can't be used with STIF_RX_SPLIT_BUFFERS"
+#endif
+
+//Both must be powers of two
+#ifndef STIF_RX_HARVEST_LEN
+#define STIF_RX_HARVEST_LEN 8
+#endif
+
+#ifndef STIF_RX_SPARES
+#define STIF_RX_SPARES 4
+#endif
+
+struct rx_slot {
+    struct pbuf *p;
+    uint32_t status;
+    uint32_t ext_status;
+    uint32_t ts_high;
+    uint32_t ts_low;
+};
+
+//Lock free single producer, single consumer queues: the interrupt handler
+//  produces harvested frames and stif_loop consumes them, while the spare
+//  buffers go the other way. The indices run freely and only ever get
+//  written by one side.
+static struct rx_slot rx_harvest_slots[STIF_RX_HARVEST_LEN];
+static volatile u32_t rx_harvest_head;
+static volatile u32_t rx_harvest_tail;
+
+static struct pbuf *rx_spares[STIF_RX_SPARES];
+static volatile u32_t rx_spare_head;
+static volatile u32_t rx_spare_tail;
+
+#define RX_QUEUE_LEN STIF_RX_HARVEST_LEN
+#define RX_POOL_EXTRA (STIF_RX_SPARES + STIF_RX_HARVEST_LEN)
+#else
+#define RX_QUEUE_LEN STIF_NUM_RX_DMA_DESC
+#define RX_POOL_EXTRA STIF_NUM_RX_DMA_DESC
+#endif
+
+//Receive buffers come from a pool private to the driver so the rest of
+//  the stack can't starve the ring (and vice versa).
+#ifndef STIF_RX_POOL_SIZE
+#define STIF_RX_POOL_SIZE (STIF_NUM_RX_DMA_DESC + RX_POOL_EXTRA)
+#endif
+
+//Large enough for a full (VLAN tagged) frame including the CRC
+#ifndef STIF_RX_BUF_SIZE
+#define STIF_RX_BUF_SIZE 1524
+#endif
+
+#ifndef RX_DESC_BUF_SIZE
+#define RX_DESC_BUF_SIZE STIF_RX_BUF_SIZE
+#endif
+
+struct rx_pool;
+
+struct rx_buf {
+    struct pbuf_custom pc;
+    struct rx_buf *next;
+    struct rx_pool *pool;
+};
+
+struct rx_pool {
+    struct rx_buf *free;
+    u16_t buf_size;
+    struct stif_pool_stats *stats;
+};
+
+//The buffer data directly follows the rx_buf header
+#define RX_BUF_TYPE(size) struct { struct rx_buf hdr; uint32_t data[((size)+3)/4]; }
+
+static RX_BUF_TYPE(STIF_RX_BUF_SIZE) rx_bufs[STIF_RX_POOL_SIZE];
+static struct rx_pool rx_pool;
+
+#if STIF_RX_SPLIT_BUFFERS
+static RX_BUF_TYPE(STIF_RX_SMALL_BUF_SIZE) rx_small_bufs[STIF_RX_SMALL_POOL_SIZE];
+static struct rx_pool rx_small_pool;
+#endif
+
+//Frames shorter than this are copied into a PBUF_RAM so the full sized
+//  DMA buffer can go straight back to the ring.
+#ifndef STIF_RX_COPYBREAK
+#define STIF_RX_COPYBREAK 256
+#endif
+
+//Have the MAC pass frames with CRC and other errors up to the driver (rather
+//  than silently dropping them in the FIFO) so they show up in rx_errors.
+#ifndef STIF_RX_FORWARD_ERROR_FRAMES
+#define STIF_RX_FORWARD_ERROR_FRAMES 0
+#endif
+
+//Limits used by the adaptive interrupt moderation: the delay is chosen to
+//  collect about FRAMES frames per interrupt. Below MIN_RATE frames/s, or
+//  when that would take longer than MAX_USECS, every frame interrupts.
+#ifndef STIF_IRQ_MODERATION_MIN_RATE
+#define STIF_IRQ_MODERATION_MIN_RATE 1000
+#endif
+
+#ifndef STIF_IRQ_MODERATION_FRAMES
+#define STIF_IRQ_MODERATION_FRAMES ((STIF_NUM_RX_DMA_DESC + 1) / 2)
+#endif
+
+#ifndef STIF_IRQ_MODERATION_MAX_USECS
+#define STIF_IRQ_MODERATION_MAX_USECS 500
+#endif
+
+static int irq_moderation = STIF_IRQ_MODERATION;
+static uint32_t rx_desc_dic;
+
+static int rx_budget = STIF_RX_BUDGET;
+//802.3x flow control: when stif_loop finds no more than
+//  STIF_PAUSE_LOW_WATER receive descriptors still armed a PAUSE frame is
+//  sent, and once a later call finds STIF_PAUSE_HIGH_WATER armed again a
+//  zero quanta PAUSE releases the link partner early. It changes what the PHY advertises so it's off by
+//  default.
+#ifndef STIF_FLOW_CONTROL
+#define STIF_FLOW_CONTROL 0
+#endif
+
+//Received PAUSE frames are acted on by the MAC and dropped. Forwarding
+//  them into the receive ring just so they can be counted costs
+//  descriptors exactly when the link partner is congested, so it's
+//  optional.
+#ifndef STIF_PAUSE_FORWARD
+#define STIF_PAUSE_FORWARD 0
+#endif
+
+//The PAUSE time is this percentage of the stif_tmr interval it's
+//  refreshed at, so if the resume frame is lost the link partner is only
+//  held off a little longer than that.
+#ifndef STIF_PAUSE_MARGIN
+#define STIF_PAUSE_MARGIN 125
+#endif
+
+#ifndef STIF_PAUSE_LOW_WATER
+#define STIF_PAUSE_LOW_WATER 2
+#endif
+
+#ifndef STIF_PAUSE_HIGH_WATER
+#define STIF_PAUSE_HIGH_WATER STIF_NUM_RX_DMA_DESC
+#endif
+
+static int flow_control;
+static volatile int rx_paused;
+
+//Rate at which the PTP sub-second counter is advanced, it must be lower
+//  than HCLK.
+#ifndef STIF_PTP_CLOCK_FREQ
+#define STIF_PTP_CLOCK_FREQ 50000000
+#endif
+
+#if STIF_PTP
+static stif_timestamp_fn rx_timestamp_cb;
+static stif_timestamp_fn tx_timestamp_cb;
+#endif
+
+static int rx_copybreak = STIF_RX_COPYBREAK;
+static struct stif_stats stats;
+
+static inline uint32_t cycles_now(void)
+{
+    #if STIF_CYCLE_STATS
+    return DWT->CYCCNT;
+    #else
+    return 0;
+    #endif
+}
+
+//Always records, for the few measurements (like recovery times) that are
+//  kept even without STIF_CYCLE_STATS
+static inline void cycles_record(struct stif_cycles *c, uint32_t start)
+{
+    uint32_t cycles = DWT->CYCCNT - start;
+
+    c->calls++;
+    c->total += cycles;
+    if (cycles > c->max)
+        c->max = cycles;
+}
+
+static inline void cycles_add(struct stif_cycles *c, uint32_t start)
+{
+    #if STIF_CYCLE_STATS
+    cycles_record(c, start);
+    #endif
+}
+
+static void hist_add(u32_t *hist, int count, int size)
+{
+    hist[count * (STIF_HIST_BUCKETS - 1) / size]++;
+}
+
+#if STIF_FAULT_INJECTION
+static u32_t fault_count[STIF_FAULTS];
+
+static int fault_hit(int fault)
+{
+    if (!fault_count[fault])
+        return 0;
+
+    fault_count[fault]--;
+    stats.faults_injected++;
+    return 1;
+}
+#else
+#define fault_hit(fault) 0
+#endif
 
 static enum {
     NO_CHANGE,
@@ -70,12 +447,36 @@ static enum {
     LINK_DOWN,
 } phy_link_status;
 
+//Set by the PHY interrupt, the interrupt status register is read (which
+//  also clears it) from stif_loop.
+static volatile int phy_event;
+static struct netif *phy_netif;
+
+//PHY registers are accessed through a queue of MDIO transactions which
+//  is advanced from stif_loop so nothing waits on the (slow) MDIO bus.
+#ifndef STIF_MDIO_QUEUE_LEN
+#define STIF_MDIO_QUEUE_LEN 4
+#endif
+
+typedef void (*mdio_done_fn)(int value);
+
+static struct mdio_op {
+    u8_t reg;
+    u8_t write;
+    u16_t value;
+    mdio_done_fn done;
+} mdio_queue[STIF_MDIO_QUEUE_LEN];
+static int mdio_head;
+static int mdio_count;
+
 static void mac_reset(void)
 {
     ETH->DMABMR |= ETH_DMABMR_SR;
     while (ETH->DMABMR & ETH_DMABMR_SR);
 }
 
+//The blocking accessors are only used while initializing, before the
+//  MDIO queue is in use.
 static int phy_read_reg(int phy_reg)
 {
     int regval = ETH->MACMIIAR;
@@ -152,10 +553,53 @@ static err_t phy_setup_access(void)
     return phy_addr;
 }
 
+static void phy_advertise_pause(void)
+{
+    int ad = phy_read_reg(PHY_REG_AUTO_NEG_AD);
+    if (ad & PHY_AUTO_NEG_AD_PAUSE)
+        return;
+
+    phy_write_reg(PHY_REG_AUTO_NEG_AD, ad | PHY_AUTO_NEG_AD_PAUSE);
+    phy_write_reg(PHY_REG_BASIC_CTRL, phy_read_reg(PHY_REG_BASIC_CTRL) |
+                  PHY_BCR_RESTART_AUTO_NEG);
+
+    //Wait for the link up interrupt from the new negotiation
+    phy_link_status = NO_CHANGE;
+}
+
+#if STIF_PTP
+static void ptp_init(void)
+{
+    //Timestamp every frame and use the digital rollover mode so the
+    //  sub-second counter is in nanoseconds.
+    ETH->PTPTSCR = ETH_PTPTSCR_TSE | ETH_PTPTSSR_TSSARFE | ETH_PTPTSSR_TSSSR;
+
+    //Fine update mode: the addend is accumulated every HCLK cycle and the
+    //  sub-second counter is incremented each time it overflows.
+    ETH->PTPSSIR = 1000000000 / STIF_PTP_CLOCK_FREQ;
+    ETH->PTPTSAR = ((uint64_t) STIF_PTP_CLOCK_FREQ << 32) / clock_get_freq(ETH);
+    ETH->PTPTSCR |= ETH_PTPTSCR_TSARU;
+    while (ETH->PTPTSCR & ETH_PTPTSCR_TSARU);
+    ETH->PTPTSCR |= ETH_PTPTSCR_TSFCU;
+
+    ETH->PTPTSHUR = 0;
+    ETH->PTPTSLUR = 0;
+    ETH->PTPTSCR |= ETH_PTPTSCR_TSSTI;
+    while (ETH->PTPTSCR & ETH_PTPTSCR_TSSTI);
+}
+#endif
+
 static err_t mac_init(void)
 {
     mac_reset();
+
+    #if STIF_FLOW_CONTROL
+    //Without a PHY there's nothing to advertise to
+    if (phy_setup_access() > 0)
+        phy_advertise_pause();
+    #else
     phy_setup_access();
+    #endif
 
     ETH->MACCR |= (ETH_MACCR_FES |
                    ETH_MACCR_ROD |
@@ -165,207 +609,1107 @@ static err_t mac_init(void)
     ETH->MACFFR = 0;
     ETH->MACFCR = 0;
 
+    //The MMC counters are reset on read and accumulated into the stats,
+    //  their interrupts are masked as nothing services them.
+    ETH->MMCCR = ETH_MMCCR_ROR;
+    ETH->MMCRIMR = (ETH_MMCRIMR_RGUFM |
+                    ETH_MMCRIMR_RFAEM |
+                    ETH_MMCRIMR_RFCEM);
+    ETH->MMCTIMR = (ETH_MMCTIMR_TGFM |
+                    ETH_MMCTIMR_TGFMSCM |
+                    ETH_MMCTIMR_TGFSCM);
+
+    //The cycle counter is also the time base for the TX token buckets
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    #if STIF_FLOW_CONTROL && STIF_PAUSE_FORWARD
+    //Pass PAUSE frames up as well as acting on them so they can be counted
+    ETH->MACFFR |= ETH_MACFFR_PCF_ForwardAll;
+    #endif
+
     ETH->DMAOMR = (ETH_DMAOMR_DTCEFD |
                    ETH_DMAOMR_RSF |
                    ETH_DMAOMR_TSF |
                    ETH_DMAOMR_OSF);
 
+    #if STIF_RX_FORWARD_ERROR_FRAMES
+    ETH->DMAOMR |= ETH_DMAOMR_FEF;
+    #endif
+
     ETH->DMABMR = (ETH_DMABMR_AAB |
                    ETH_DMABMR_FB |
                    ETH_DMABMR_RTPR_2_1 |
                    (32 << 17) |  //RX Burst Length
                    (32 << 8)  |  //TX Burst Length
                    ETH_DMABMR_USP |
-                   ETH_DMABMR_EDE);
+                   ETH_DMABMR_EDE |
+                   //Descriptor skip length (in words) for ring mode
+                   (((sizeof(struct dma_desc) - 32) / 4) << 2));
+
+    #if STIF_PTP
+    ptp_init();
+    #endif
 
     return ERR_OK;
 }
 
+static inline struct dma_desc *tx_next_desc(struct dma_desc *desc)
+{
+    if (++desc == &tx_dma_desc[STIF_NUM_TX_DMA_DESC])
+        desc = &tx_dma_desc[0];
+
+    return desc;
+}
+
 static void init_tx_dma_desc(void)
 {
     for (int i = 0; i < STIF_NUM_TX_DMA_DESC; i++) {
-        tx_dma_desc[i].Status = ETH_DMATxDesc_TCH | ETH_DMATxDesc_CIC_TCPUDPICMP_Full;
         tx_dma_desc[i].pbuf = NULL;
-        tx_dma_desc[i].Buffer2NextDescAddr = &tx_dma_desc[i+1];
+#if STIF_TX_RING_MODE
+        tx_dma_desc[i].Status = ETH_DMATxDesc_CIC_TCPUDPICMP_Full;
+#else
+        tx_dma_desc[i].Status = ETH_DMATxDesc_TCH | ETH_DMATxDesc_CIC_TCPUDPICMP_Full;
+        tx_dma_desc[i].Buffer2NextDescAddr = tx_next_desc(&tx_dma_desc[i]);
+#endif
     }
 
-    tx_dma_desc[STIF_NUM_TX_DMA_DESC-1].Buffer2NextDescAddr = &tx_dma_desc[0];
+#if STIF_TX_RING_MODE
+    tx_dma_desc[STIF_NUM_TX_DMA_DESC-1].Status |= ETH_DMATxDesc_TER;
+#endif
 
     ETH->DMATDLAR = (uint32_t) tx_dma_desc;
     tx_cur_dma_desc = &tx_dma_desc[0];
+    tx_clean_dma_desc = &tx_dma_desc[0];
+    tx_free_descs = STIF_NUM_TX_DMA_DESC;
 }
 
 
-static void init_rx_dma_desc(void)
+static inline struct dma_desc *rx_next_desc(struct dma_desc *desc)
 {
-    for (int i = 0; i < STIF_NUM_RX_DMA_DESC; i++) {
-        rx_dma_desc[i].Status = ETH_DMARxDesc_OWN;
-        rx_dma_desc[i].ControlBufferSize = ETH_DMARxDesc_RCH | PBUF_POOL_BUFSIZE;
-        rx_dma_desc[i].pbuf = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
-        rx_dma_desc[i].Buffer1Addr = rx_dma_desc[i].pbuf->payload;
-        rx_dma_desc[i].Buffer2NextDescAddr = &rx_dma_desc[i+1];
-    }
+    if (++desc == &rx_dma_desc[STIF_NUM_RX_DMA_DESC])
+        desc = &rx_dma_desc[0];
 
-    rx_dma_desc[STIF_NUM_RX_DMA_DESC-1].Buffer2NextDescAddr = &rx_dma_desc[0];
-    ETH->DMARDLAR = (uint32_t) rx_dma_desc;
-    rx_cur_dma_desc = &rx_dma_desc[0];
+    return desc;
 }
 
-#if LWIP_IGMP
+static inline void *rx_buf_data(struct rx_buf *buf)
+{
+    return buf + 1;
+}
 
-static err_t mac_filter(struct netif *netif, ip_addr_t *group, u8_t action)
+static struct rx_buf *rx_buf_get(struct rx_pool *pool)
 {
-    uint32_t macaddr_low = 0x5E0001 | ((ip4_addr2(group) & 0x7F) << 24);
-    uint32_t macaddr_high = ip4_addr3(group) | (ip4_addr4(group) << 8);
+    struct rx_buf *buf = pool->free;
+    struct stif_pool_stats *pstats = pool->stats;
 
-    LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE,
-                ("stif: adding mac filter for %08lx%04lx\n",
-               htonl(macaddr_low), htonl(macaddr_high)));
+    if (buf == NULL || fault_hit(STIF_FAULT_RX_BUF)) {
+        pstats->starved++;
+        return NULL;
+    }
 
-    __IO uint32_t *mach = &ETH->MACA1HR;
-    __IO uint32_t *macl = &ETH->MACA1LR;
-    int slot;
+    pool->free = buf->next;
+    pstats->free--;
+    if (pstats->free < pstats->low_watermark)
+        pstats->low_watermark = pstats->free;
 
-    for (slot = 0; slot < 3; slot++) {
-        if (macl[slot*2] != macaddr_low)
-            continue;
-        if ((mach[slot*2] & 0xFFFF) == macaddr_high)
-            break;
-    }
+    return buf;
+}
 
-    if (slot != 3) {
-        if (action == IGMP_ADD_MAC_FILTER)
-            mach[slot*2] |= ETH_MACA1HR_AE;
-        else if (action == IGMP_DEL_MAC_FILTER)
-            mach[slot*2] &= ~ETH_MACA1HR_AE;
+static struct pbuf *rx_buf_pbuf(struct rx_buf *buf)
+{
+    return pbuf_alloced_custom(PBUF_RAW, buf->pool->buf_size, PBUF_REF,
+                               &buf->pc, rx_buf_data(buf),
+                               buf->pool->buf_size);
+}
 
-        return ERR_OK;
-    }
+static void rx_arm_desc(struct dma_desc *desc, struct pbuf *p)
+{
+    desc->pbuf = p;
+    desc->Buffer1Addr = p->payload;
+    desc->ControlBufferSize &= ~ETH_DMARxDesc_DIC;
+    desc->ControlBufferSize |= rx_desc_dic;
+    desc->Status = ETH_DMARxDesc_OWN;
+}
 
-    if (action == IGMP_DEL_MAC_FILTER)
-        return ERR_OK;
+#if !STIF_RX_ISR_HARVEST
+static int rx_attach_bufs(struct dma_desc *desc)
+{
+    struct rx_buf *buf;
 
-    for (slot = 0; slot < 3; slot++) {
-        if (mach[slot*2] & ETH_MACA1HR_AE)
-            continue;
+#if STIF_RX_SPLIT_BUFFERS
+    //The large buffer is attached first: a descriptor only counts as
+    //  refilled once its first buffer is present.
+    if (desc->pbuf2 == NULL) {
+        if ((buf = rx_buf_get(&rx_pool)) == NULL)
+            return 0;
 
-        macl[slot*2] = macaddr_low;
-        mach[slot*2] = macaddr_high | ETH_MACA1HR_AE;
-        return ERR_OK;
+        desc->pbuf2 = rx_buf_pbuf(buf);
+        desc->Buffer2NextDescAddr = rx_buf_data(buf);
     }
 
-    LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE,
-                ("stif: all filter slots used up; enabling pass-all-multiplex\n"));
+    if ((buf = rx_buf_get(&rx_small_pool)) == NULL)
+        return 0;
+#else
+    if ((buf = rx_buf_get(&rx_pool)) == NULL)
+        return 0;
+#endif
 
-    ETH->MACFFR |= ETH_MACFFR_PAM;
+    rx_arm_desc(desc, rx_buf_pbuf(buf));
 
-    return ERR_OK;
+    return 1;
 }
-
 #endif
 
-static void read_hwaddr_from_otp(struct netif *netif)
+static void rx_poll_demand(void)
 {
-    memcpy(netif->hwaddr, (void *) 0x1FFF7800, ETHARP_HWADDR_LEN);
-
-    if (memcmp(netif->hwaddr, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) != 0)
+    if (fault_hit(STIF_FAULT_POLL_DEMAND))
         return;
 
-    //Fall back on data from the Unique Device ID Registers
-    netif->hwaddr[0] = 0x32;
-    netif->hwaddr[1] = 0xCC;
-    netif->hwaddr[2] = 0xDD;
-    memcpy(&netif->hwaddr[3], (void *) 0x1FFF7A10, 3);
+    if (ETH->DMASR & ETH_DMASR_RBUS) {
+        ETH->DMASR = ETH_DMASR_RBUS;
+        ETH->DMARPDR = 0;
+    }
 }
 
-__attribute__((__interrupt__))
-static void eth_interrupt(void)
+static void rx_recovery_begin(void)
 {
-    //Just used to wakeup from sleep, reception is handled in the main loop.
-    ETH->DMASR = ETH_DMASR_ERS | ETH_DMASR_RS | ETH_DMASR_NIS;
+    if (rx_recovering)
+        return;
+
+    //Stalls are rare, so these are timed whether or not the per-stage
+    //  cycle stats are enabled. mac_init always starts the counter.
+    rx_recovering = 1;
+    rx_recovery_start = DWT->CYCCNT;
 }
 
-static void low_level_init(struct netif *netif)
+#if STIF_RX_ISR_HARVEST
+//Runs in the interrupt handler, or with its interrupt disabled
+static int rx_harvest(void)
 {
-    /* set MAC hardware address length */
-    netif->hwaddr_len = ETHARP_HWADDR_LEN;
-
-    read_hwaddr_from_otp(netif);
+    int ret = 0;
 
-    ETH->MACA0HR = ((netif->hwaddr[5] << 8) |
-                    (netif->hwaddr[4] << 0));
-    ETH->MACA0LR = ((netif->hwaddr[3] << 24) |
-                    (netif->hwaddr[2] << 16) |
-                    (netif->hwaddr[1] << 8) |
-                    (netif->hwaddr[0] << 0));
+    while (!(rx_cur_dma_desc->Status & ETH_DMARxDesc_OWN) &&
+           rx_cur_dma_desc->pbuf != NULL)
+    {
+        u32_t head = rx_harvest_head;
+        if (head - rx_harvest_tail == STIF_RX_HARVEST_LEN) {
+            stats.rx_harvest_full++;
+            break;
+        }
 
-    /* maximum transfer unit */
-    netif->mtu = 1500;
+        struct rx_slot *slot = &rx_harvest_slots[head % STIF_RX_HARVEST_LEN];
+        slot->p = rx_cur_dma_desc->pbuf;
+        slot->status = rx_cur_dma_desc->Status;
+        slot->ext_status = rx_cur_dma_desc->ExtendedStatus;
+        slot->ts_high = rx_cur_dma_desc->TimeStampHigh;
+        slot->ts_low = rx_cur_dma_desc->TimeStampLow;
 
-    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
+        //The slot has to be complete before stif_loop can see it
+        __sync_synchronize();
+        rx_harvest_head = head + 1;
 
-    #if LWIP_IGMP
-    netif->flags |= NETIF_FLAG_IGMP;
-    netif_set_igmp_mac_filter(netif, mac_filter);
-    #endif
+        rx_cur_dma_desc->pbuf = NULL;
+        rx_cur_dma_desc = rx_next_desc(rx_cur_dma_desc);
+        ret++;
+    }
 
-    init_tx_dma_desc();
-    init_rx_dma_desc();
+    int armed = 0;
+    while (rx_refill_dma_desc->pbuf == NULL &&
+           rx_spare_tail != rx_spare_head)
+    {
+        u32_t tail = rx_spare_tail;
+        rx_arm_desc(rx_refill_dma_desc, rx_spares[tail % STIF_RX_SPARES]);
 
-    /* Enable MAC and DMA transmission and reception */
-    ETH->MACCR |= (ETH_MACCR_TE | ETH_MACCR_RE);
-    ETH->DMAOMR |= ETH_DMAOMR_FTF;
-    ETH->DMAOMR |= ETH_DMAOMR_ST | ETH_DMAOMR_SR;
+        __sync_synchronize();
+        rx_spare_tail = tail + 1;
 
-    ETH->DMAIER = ETH_DMAIER_ERIE | ETH_DMAIER_RIE | ETH_DMAIER_NISE;
+        rx_refill_dma_desc = rx_next_desc(rx_refill_dma_desc);
+        armed++;
+    }
 
-    int_register(ETH_IRQn, eth_interrupt);
-    int_enable(ETH_IRQn);
+    if (armed)
+        rx_poll_demand();
+    else if (rx_cur_dma_desc->pbuf == NULL)
+        rx_recovery_begin();
 
+    return ret;
 }
 
-
-static void prepare_tx_descr(struct pbuf *p, int first, int last)
+//The spare ring is only produced here, so this doesn't need the interrupt
+//  masked
+static int rx_fill_spares(void)
 {
-    while (tx_cur_dma_desc->Status & ETH_DMATxDesc_OWN);
-
-    if (tx_cur_dma_desc->pbuf != NULL)
-        pbuf_free(tx_cur_dma_desc->pbuf);
+    int ret = 0;
 
-    pbuf_ref(p);
-    tx_cur_dma_desc->pbuf = p;
+    while (rx_spare_head - rx_spare_tail < STIF_RX_SPARES) {
+        struct rx_buf *buf = rx_buf_get(&rx_pool);
+        if (buf == NULL) {
+            if (rx_refill_dma_desc->pbuf == NULL)
+                stats.rx_refill_failures++;
+            break;
+        }
 
-    tx_cur_dma_desc->Status &= ~(ETH_DMATxDesc_FS | ETH_DMATxDesc_LS);
-    if (first)
-        tx_cur_dma_desc->Status |= ETH_DMATxDesc_FS;
-    if (last)
-        tx_cur_dma_desc->Status |= ETH_DMATxDesc_LS;
+        u32_t head = rx_spare_head;
+        rx_spares[head % STIF_RX_SPARES] = rx_buf_pbuf(buf);
 
-    tx_cur_dma_desc->Buffer1Addr = p->payload;
-    tx_cur_dma_desc->ControlBufferSize = p->len;
-    tx_cur_dma_desc->Status |= ETH_DMATxDesc_OWN;
+        __sync_synchronize();
+        rx_spare_head = head + 1;
+        ret++;
+    }
 
-    tx_cur_dma_desc = tx_cur_dma_desc->Buffer2NextDescAddr;
+    return ret;
 }
 
-static err_t low_level_output(struct netif *netif, struct pbuf *p)
+static int realloc_rxdma_buffers(void)
 {
-    struct pbuf *q;
+    int ret = rx_fill_spares();
+
+    //The ring itself belongs to the interrupt handler. This also catches
+    //  frames the interrupt hasn't been raised for yet (with moderation).
+    int_disable(ETH_IRQn);
 
-    for(q = p; q != NULL; q = q->next)
-        prepare_tx_descr(q, q == p, q->next == NULL);
+    ret += rx_harvest();
 
-    if (ETH->DMASR & ETH_DMASR_TBUS) {
-        ETH->DMASR = ETH_DMASR_TBUS;
-        ETH->DMATPDR = 0;
+    if (rx_recovering && rx_refill_dma_desc->pbuf != NULL) {
+        rx_recovering = 0;
+        cycles_record(&stats.rx_recovery_cycles, rx_recovery_start);
     }
 
-    return ERR_OK;
-}
+    int_enable(ETH_IRQn);
 
-static void setup_speed_and_duplex(void)
+    return ret;
+}
+#else
+static int realloc_rxdma_buffers(void)
 {
-    int mode = phy_read_reg(PHY_REG_CONTROLLER) & PHY_CTRL_MODE;
+    int ret = 0;
+
+    while (rx_refill_dma_desc->pbuf == NULL) {
+        if (!rx_attach_bufs(rx_refill_dma_desc)) {
+            stats.rx_refill_failures++;
+            if (rx_cur_dma_desc->pbuf == NULL)
+                rx_recovery_begin();
+            break;
+        }
+
+        rx_refill_dma_desc = rx_next_desc(rx_refill_dma_desc);
+        ret++;
+    }
+
+    if (ret)
+        rx_poll_demand();
+
+    if (rx_recovering && rx_refill_dma_desc->pbuf != NULL) {
+        rx_recovering = 0;
+        cycles_record(&stats.rx_recovery_cycles, rx_recovery_start);
+    }
+
+    return ret;
+}
+#endif
+
+static void rx_buf_put(struct pbuf *p)
+{
+    struct rx_buf *buf = (struct rx_buf *) p;
+    struct rx_pool *pool = buf->pool;
+
+    buf->next = pool->free;
+    pool->free = buf;
+    pool->stats->free++;
+}
+
+static void rx_buf_free(struct pbuf *p)
+{
+    rx_buf_put(p);
+
+    #if STIF_RX_ISR_HARVEST
+    //Only the spare ring is topped up: the interrupt handler or the next
+    //  stif_loop arms the descriptors from it, so freeing a frame doesn't
+    //  mask the interrupt.
+    rx_fill_spares();
+    #else
+    //If a descriptor is waiting for a buffer this hands it straight
+    //  back to the DMA.
+    realloc_rxdma_buffers();
+    #endif
+}
+
+static void rx_pool_init(struct rx_pool *pool, void *bufs, int count,
+                         int stride, int buf_size,
+                         struct stif_pool_stats *pstats)
+{
+    pool->free = NULL;
+    pool->buf_size = buf_size;
+    pool->stats = pstats;
+
+    for (int i = 0; i < count; i++) {
+        struct rx_buf *buf = (struct rx_buf *) ((char *) bufs + i * stride);
+        buf->pc.custom_free_function = rx_buf_free;
+        buf->pool = pool;
+        buf->next = pool->free;
+        pool->free = buf;
+    }
+
+    pstats->size = count;
+    pstats->free = count;
+    pstats->low_watermark = count;
+}
+
+static void init_rx_dma_desc(void)
+{
+    rx_pool_init(&rx_pool, rx_bufs, STIF_RX_POOL_SIZE, sizeof(*rx_bufs),
+                 STIF_RX_BUF_SIZE, &stats.rx_pool);
+
+#if STIF_RX_SPLIT_BUFFERS
+    rx_pool_init(&rx_small_pool, rx_small_bufs, STIF_RX_SMALL_POOL_SIZE,
+                 sizeof(*rx_small_bufs), STIF_RX_SMALL_BUF_SIZE,
+                 &stats.rx_small_pool);
+#endif
+
+    for (int i = 0; i < STIF_NUM_RX_DMA_DESC; i++) {
+        rx_dma_desc[i].Status = 0;
+        rx_dma_desc[i].pbuf = NULL;
+        rx_dma_desc[i].pbuf2 = NULL;
+
+#if STIF_RX_SPLIT_BUFFERS
+        rx_dma_desc[i].ControlBufferSize = ((STIF_RX_BUF_SIZE << 16) |
+                                            STIF_RX_SMALL_BUF_SIZE);
+#else
+        rx_dma_desc[i].ControlBufferSize = (ETH_DMARxDesc_RCH |
+                                            STIF_RX_BUF_SIZE);
+        rx_dma_desc[i].Buffer2NextDescAddr = rx_next_desc(&rx_dma_desc[i]);
+#endif
+    }
+
+#if STIF_RX_SPLIT_BUFFERS
+    rx_dma_desc[STIF_NUM_RX_DMA_DESC-1].ControlBufferSize |= ETH_DMARxDesc_RER;
+#endif
+
+    rx_cur_dma_desc = &rx_dma_desc[0];
+    rx_refill_dma_desc = &rx_dma_desc[0];
+    realloc_rxdma_buffers();
+
+    ETH->DMARDLAR = (uint32_t) rx_dma_desc;
+}
+
+#if LWIP_IGMP
+
+//Reference counts for the 64 buckets of the multicast hash filter, so a
+//  bucket is only cleared once every group hashing to it has been left.
+static u8_t mc_hash_refs[64];
+
+//32 groups share each multicast MAC address, so the perfect filter slots
+//  are reference counted the same way.
+static u8_t mc_perfect_refs[3];
+
+static int mc_hash_bucket(uint32_t macaddr_low, uint32_t macaddr_high)
+{
+    u8_t addr[6] = {macaddr_low, macaddr_low >> 8, macaddr_low >> 16,
+                    macaddr_low >> 24, macaddr_high, macaddr_high >> 8};
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (int i = 0; i < sizeof(addr); i++) {
+        crc ^= addr[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+
+    //The MAC uses the upper 6 bits of the bit reversed (inverted) CRC
+    crc = ~crc;
+    int bucket = 0;
+    for (int bit = 0; bit < 6; bit++)
+        bucket = (bucket << 1) | ((crc >> bit) & 1);
+
+    return bucket;
+}
+
+static void mc_hash_update(int bucket, u8_t action)
+{
+    __IO uint32_t *reg = (bucket & 0x20) ? &ETH->MACHTHR : &ETH->MACHTLR;
+    uint32_t mask = 1 << (bucket & 0x1F);
+
+    if (action == IGMP_ADD_MAC_FILTER) {
+        if (mc_hash_refs[bucket]++ == 0)
+            *reg |= mask;
+        stats.mc_hash_groups++;
+    } else {
+        if (mc_hash_refs[bucket] == 0)
+            return;
+        if (--mc_hash_refs[bucket] == 0)
+            *reg &= ~mask;
+        stats.mc_hash_groups--;
+    }
+
+    if (ETH->MACHTHR || ETH->MACHTLR)
+        ETH->MACFFR |= ETH_MACFFR_HM | ETH_MACFFR_HPF;
+    else
+        ETH->MACFFR &= ~(ETH_MACFFR_HM | ETH_MACFFR_HPF);
+}
+
+static err_t mac_filter(struct netif *netif, ip_addr_t *group, u8_t action)
+{
+    uint32_t macaddr_low = 0x5E0001 | ((ip4_addr2(group) & 0x7F) << 24);
+    uint32_t macaddr_high = ip4_addr3(group) | (ip4_addr4(group) << 8);
+
+    LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE,
+                ("stif: %s mac filter for %08lx%04lx\n",
+                 action == IGMP_ADD_MAC_FILTER ? "adding" : "removing",
+               htonl(macaddr_low), htonl(macaddr_high)));
+
+    __IO uint32_t *mach = &ETH->MACA1HR;
+    __IO uint32_t *macl = &ETH->MACA1LR;
+    int slot;
+
+    for (slot = 0; slot < 3; slot++) {
+        if (!(mach[slot*2] & ETH_MACA1HR_AE))
+            continue;
+        if (macl[slot*2] != macaddr_low)
+            continue;
+        if ((mach[slot*2] & 0xFFFF) == macaddr_high)
+            break;
+    }
+
+    if (slot != 3) {
+        if (action == IGMP_ADD_MAC_FILTER) {
+            mc_perfect_refs[slot]++;
+        } else if (--mc_perfect_refs[slot] == 0) {
+            mach[slot*2] &= ~ETH_MACA1HR_AE;
+            stats.mc_perfect_groups--;
+        }
+
+        return ERR_OK;
+    }
+
+    if (action == IGMP_ADD_MAC_FILTER) {
+        for (slot = 0; slot < 3; slot++) {
+            if (mach[slot*2] & ETH_MACA1HR_AE)
+                continue;
+
+            macl[slot*2] = macaddr_low;
+            mach[slot*2] = macaddr_high | ETH_MACA1HR_AE;
+            mc_perfect_refs[slot] = 1;
+            stats.mc_perfect_groups++;
+            return ERR_OK;
+        }
+
+        LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE,
+                    ("stif: all filter slots used up; using the hash filter\n"));
+    }
+
+    mc_hash_update(mc_hash_bucket(macaddr_low, macaddr_high), action);
+
+    return ERR_OK;
+}
+
+#endif
+
+//Where the MAC address is programmed in the OTP area and the Unique Device
+//  ID registers used when it isn't.
+#ifndef STIF_OTP_HWADDR
+#define STIF_OTP_HWADDR ((void *) 0x1FFF7800)
+#endif
+
+#ifndef STIF_UNIQUE_ID
+#define STIF_UNIQUE_ID ((void *) 0x1FFF7A10)
+#endif
+
+static void read_hwaddr_from_otp(struct netif *netif)
+{
+    memcpy(netif->hwaddr, STIF_OTP_HWADDR, ETHARP_HWADDR_LEN);
+
+    if (memcmp(netif->hwaddr, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) != 0)
+        return;
+
+    //Fall back on data from the Unique Device ID Registers
+    netif->hwaddr[0] = 0x32;
+    netif->hwaddr[1] = 0xCC;
+    netif->hwaddr[2] = 0xDD;
+    memcpy(&netif->hwaddr[3], STIF_UNIQUE_ID, 3);
+}
+
+#if STIF_FLOW_CONTROL
+//A quantum is 512 bit times at the negotiated speed
+static uint32_t pause_time(void)
+{
+    uint32_t bits_per_ms = (ETH->MACCR & ETH_MACCR_FES) ? 100000 : 10000;
+    uint32_t quanta = STIF_TMR_INTERVAL * bits_per_ms / 512 *
+        STIF_PAUSE_MARGIN / 100;
+
+    return quanta > 0xFFFF ? 0xFFFF : quanta;
+}
+
+static int send_pause(uint32_t quanta)
+{
+    //MACFCR must not be written while a PAUSE frame is still pending
+    if (ETH->MACFCR & ETH_MACFCR_FCBBPA)
+        return 0;
+
+    ETH->MACFCR = (ETH->MACFCR & ~ETH_MACFCR_PT) | (quanta << 16);
+    ETH->MACFCR |= ETH_MACFCR_FCBBPA;
+
+    return 1;
+}
+
+static int rx_armed_descs(void)
+{
+    int armed = 0;
+    for (int i = 0; i < STIF_NUM_RX_DMA_DESC; i++)
+        if (rx_dma_desc[i].Status & ETH_DMARxDesc_OWN)
+            armed++;
+
+    #if STIF_RX_ISR_HARVEST
+    armed += rx_spare_head - rx_spare_tail;
+    #endif
+
+    return armed;
+}
+
+//Runs in the interrupt handler, or with it disabled. The receive
+//  interrupt is raised as each frame lands, so the ring running low is
+//  caught in the middle of a burst, before frames are missed, rather than
+//  by the next stif_loop.
+static void rx_pause_check(void)
+{
+    if (!flow_control || rx_paused)
+        return;
+
+    if (rx_armed_descs() <= STIF_PAUSE_LOW_WATER && send_pause(pause_time())) {
+        rx_paused = 1;
+        stats.tx_pause_frames++;
+    }
+}
+#endif
+
+__attribute__((__interrupt__))
+static void eth_interrupt(void)
+{
+    //Otherwise just used to wakeup from sleep: reception is handled in
+    //  the main loop, apart from harvesting the ring with
+    //  STIF_RX_ISR_HARVEST.
+    ETH->DMASR = ETH_DMASR_ERS | ETH_DMASR_RS | ETH_DMASR_NIS;
+    stats.irqs++;
+
+    if (ETH->DMASR & ETH_DMASR_FBES) {
+        ETH->DMASR = ETH_DMASR_FBES | ETH_DMASR_AIS;
+        dma_error = 1;
+    }
+
+    #if STIF_RX_ISR_HARVEST
+    rx_harvest();
+    #endif
+
+    #if STIF_FLOW_CONTROL
+    rx_pause_check();
+    #endif
+}
+
+static void set_rx_coalesce(int usecs)
+{
+    stats.irq_moderation_usecs = usecs > 0 ? usecs : 0;
+
+    if (usecs <= 0) {
+        //Descriptors that were armed with DIC set still interrupt
+        //  (almost) straight away.
+        rx_desc_dic = 0;
+        ETH->DMARSWTR = 1;
+        return;
+    }
+
+    //The receive watchdog counts in units of 256 bus clock cycles
+    int wdt = usecs * (clock_get_freq(ETH) / 1000000) / 256;
+    if (wdt < 1)
+        wdt = 1;
+    else if (wdt > 255)
+        wdt = 255;
+
+    ETH->DMARSWTR = wdt;
+    rx_desc_dic = ETH_DMARxDesc_DIC;
+}
+
+static void adapt_irq_moderation(u32_t rate)
+{
+    int usecs = 0;
+
+    if (rate >= STIF_IRQ_MODERATION_MIN_RATE && rate > 0)
+        usecs = STIF_IRQ_MODERATION_FRAMES * 1000000 / rate;
+
+    //A rate too low to fill the batch within the cap would only delay
+    //  every frame, so it interrupts on each one instead
+    if (usecs > STIF_IRQ_MODERATION_MAX_USECS)
+        usecs = 0;
+
+    if (usecs != stats.irq_moderation_usecs)
+        set_rx_coalesce(usecs);
+}
+
+static void low_level_init(struct netif *netif)
+{
+    /* set MAC hardware address length */
+    netif->hwaddr_len = ETHARP_HWADDR_LEN;
+
+    read_hwaddr_from_otp(netif);
+
+    ETH->MACA0HR = ((netif->hwaddr[5] << 8) |
+                    (netif->hwaddr[4] << 0));
+    ETH->MACA0LR = ((netif->hwaddr[3] << 24) |
+                    (netif->hwaddr[2] << 16) |
+                    (netif->hwaddr[1] << 8) |
+                    (netif->hwaddr[0] << 0));
+
+    /* maximum transfer unit */
+    netif->mtu = 1500;
+
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
+
+    #if LWIP_IGMP
+    netif->flags |= NETIF_FLAG_IGMP;
+    netif_set_igmp_mac_filter(netif, mac_filter);
+    #endif
+
+    init_tx_dma_desc();
+    init_rx_dma_desc();
+
+    /* Enable MAC and DMA transmission and reception */
+    ETH->MACCR |= (ETH_MACCR_TE | ETH_MACCR_RE);
+    ETH->DMAOMR |= ETH_DMAOMR_FTF;
+    ETH->DMAOMR |= ETH_DMAOMR_ST | ETH_DMAOMR_SR;
+
+    ETH->DMAIER = (ETH_DMAIER_ERIE | ETH_DMAIER_RIE | ETH_DMAIER_NISE |
+                   ETH_DMAIER_FBEIE | ETH_DMAIER_AISE);
+    stif_set_irq_moderation(irq_moderation);
+#if STIF_RX_STORM_RATE
+    stif_set_rx_storm_rate(STIF_RX_STORM_RATE, STIF_RX_STORM_BURST);
+#endif
+
+    int_register(ETH_IRQn, eth_interrupt);
+    int_enable(ETH_IRQn);
+
+}
+
+
+#if STIF_PTP
+static void tx_timestamp(struct dma_desc *desc)
+{
+    if (tx_timestamp_cb != NULL && (desc->Status & ETH_DMATxDesc_TTSS)) {
+        struct stif_timestamp ts = {
+            .sec = desc->TimeStampHigh,
+            .nsec = desc->TimeStampLow & ETH_PTPTSLR_STSS,
+        };
+        tx_timestamp_cb(desc->pbuf2, &ts);
+    }
+
+    pbuf_free(desc->pbuf2);
+    desc->pbuf2 = NULL;
+}
+#endif
+
+static int clean_finished_tx_buffers(void)
+{
+    //Reclaim every descriptor the DMA has finished with in one sweep so
+    //  the pbufs don't sit in the ring wasting memory.
+    int ret = 0;
+
+    while (tx_free_descs < STIF_NUM_TX_DMA_DESC &&
+           !(tx_clean_dma_desc->Status & ETH_DMATxDesc_OWN))
+    {
+        if (tx_clean_dma_desc->pbuf != NULL)  {
+            pbuf_free(tx_clean_dma_desc->pbuf);
+            tx_clean_dma_desc->pbuf = NULL;
+        }
+
+        #if STIF_PTP
+        if (tx_clean_dma_desc->pbuf2 != NULL)
+            tx_timestamp(tx_clean_dma_desc);
+        #endif
+
+        tx_clean_dma_desc = tx_next_desc(tx_clean_dma_desc);
+        tx_free_descs++;
+        ret++;
+    }
+
+    tx_cleaned += ret;
+
+    return ret;
+}
+
+static void tx_poll_demand(void)
+{
+    if (fault_hit(STIF_FAULT_POLL_DEMAND))
+        return;
+
+    ETH->DMASR = ETH_DMASR_TBUS;
+    ETH->DMATPDR = 0;
+}
+
+static void tx_flush(void)
+{
+    if (!tx_kick_pending)
+        return;
+
+    tx_kick_pending = 0;
+    tx_poll_demand();
+}
+
+static int tx_descs(struct pbuf *p)
+{
+    return (pbuf_clen(p) + TX_SEGS_PER_DESC - 1) / TX_SEGS_PER_DESC;
+}
+
+//Returns a new reference to the frame to transmit, which is a copy if the
+//  chain is too long, or NULL if the copy couldn't be allocated.
+static struct pbuf *tx_bounce(struct pbuf *p)
+{
+    if (tx_descs(p) <= STIF_TX_MAX_FRAME_DESCS) {
+        pbuf_ref(p);
+        return p;
+    }
+
+    struct pbuf *q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (q == NULL)
+        return NULL;
+
+    pbuf_copy(q, p);
+    stats.tx_bounced++;
+
+    return q;
+}
+
+//Fills the next descriptor with one segment, or two in ring mode
+static struct dma_desc *prepare_tx_descr(struct pbuf *p, int first, int last)
+{
+    struct dma_desc *desc = tx_cur_dma_desc;
+
+    uint32_t status = desc->Status;
+    status &= ~(ETH_DMATxDesc_FS | ETH_DMATxDesc_LS |
+                ETH_DMATxDesc_TTSE | ETH_DMATxDesc_TTSS);
+    if (first)
+        status |= ETH_DMATxDesc_FS;
+    if (last)
+        status |= ETH_DMATxDesc_LS;
+
+    desc->Buffer1Addr = p->payload;
+    desc->ControlBufferSize = p->len;
+
+#if STIF_TX_RING_MODE
+    if (p->next != NULL) {
+        desc->Buffer2NextDescAddr = p->next->payload;
+        desc->ControlBufferSize |= (p->next->len << 16) & ETH_DMATxDesc_TBS2;
+    }
+#endif
+
+    //The first descriptor is handed to the DMA only once the whole chain
+    //  is ready so it never starts on a partially queued frame.
+    if (!first)
+        status |= ETH_DMATxDesc_OWN;
+
+    desc->Status = status;
+
+    tx_cur_dma_desc = tx_next_desc(desc);
+
+    return desc;
+}
+
+static inline int tx_class_valid(int cls)
+{
+    return cls >= 0 && cls < STIF_TX_CLASSES;
+}
+
+static int tx_classify(struct pbuf *p)
+{
+    u8_t *hdr = p->payload;
+    u16_t type = (hdr[12] << 8) | hdr[13];
+
+    if (type == ETHTYPE_ARP)
+        return STIF_TX_CLASS_CONTROL;
+
+    //The ethernet, IP and UDP headers are always in the first pbuf of
+    //  frames generated by LWIP.
+    if (type != ETHTYPE_IP || p->len < SIZEOF_ETH_HDR + 20)
+        return STIF_TX_CLASS_NORMAL;
+
+    u8_t *iph = hdr + SIZEOF_ETH_HDR;
+    int dscp = iph[1] >> 2;
+
+    if (dscp >= STIF_TX_DSCP_CONTROL)
+        return STIF_TX_CLASS_CONTROL;
+    if ((dscp & ~7) == STIF_TX_DSCP_BULK)
+        return STIF_TX_CLASS_BULK;
+
+    int hlen = (iph[0] & 0xF) * 4;
+    if (iph[9] != IP_PROTO_UDP || p->len < SIZEOF_ETH_HDR + hlen + 8)
+        return STIF_TX_CLASS_NORMAL;
+
+    u16_t port = (iph[hlen + 2] << 8) | iph[hlen + 3];
+    for (int i = 0; i < STIF_TX_PORT_RULES; i++)
+        if (tx_port_class[i].port == port)
+            return tx_port_class[i].cls;
+
+    return STIF_TX_CLASS_NORMAL;
+}
+
+//The token buckets are refilled from the cycle counter. The rate is
+//  converted once, when it's set, to tokens per cycle as a 0.32 fixed
+//  point fraction so a refill is a multiply and a shift. Rates of a token
+//  per cycle or more are far beyond the link anyway.
+static u32_t tokens_per_cycle(u32_t rate)
+{
+    uint32_t hclk = clock_get_freq(ETH);
+
+    if (rate >= hclk)
+        return 0xFFFFFFFF;
+
+    return (((uint64_t) rate << 32) + hclk / 2) / hclk;
+}
+
+static inline u32_t tokens_earned(uint32_t now, uint32_t last_fill,
+                                  u32_t per_cycle)
+{
+    return ((uint64_t) (now - last_fill) * per_cycle) >> 32;
+}
+
+static int tx_bucket_ok(struct tx_queue *q)
+{
+    if (q->rate == 0)
+        return 1;
+
+    //Only move the time stamp on once at least a byte has been earned so
+    //  slow rates still accumulate when polled often.
+    uint32_t now = DWT->CYCCNT;
+    u32_t earned = tokens_earned(now, q->last_fill, q->per_cycle);
+
+    if (earned) {
+        q->last_fill = now;
+        q->tokens += earned;
+        if (q->tokens > (s32_t) q->burst)
+            q->tokens = q->burst;
+    }
+
+    return q->tokens > 0;
+}
+
+static int tx_can_send(int cls, int segs)
+{
+    if (segs > tx_free_descs)
+        clean_finished_tx_buffers();
+
+    if (segs > tx_free_descs)
+        return 0;
+
+    if (cls != STIF_TX_CLASS_CONTROL &&
+        STIF_NUM_TX_DMA_DESC - tx_free_descs + segs > STIF_TX_LOW_PRIO_DESCS)
+        return 0;
+
+    if (!tx_bucket_ok(&tx_queues[cls])) {
+        stats.tx_class[cls].throttled++;
+        return 0;
+    }
+
+    return 1;
+}
+
+static struct pbuf *tx_next_segs(struct pbuf *p)
+{
+    for (int i = 0; i < TX_SEGS_PER_DESC && p != NULL; i++)
+        p = p->next;
+
+    return p;
+}
+
+static void tx_submit(struct pbuf *p, int segs, int cls)
+{
+    struct pbuf *q = tx_next_segs(p);
+    struct dma_desc *first, *last;
+
+    first = last = prepare_tx_descr(p, 1, q == NULL);
+    for(; q != NULL; q = tx_next_segs(q))
+        last = prepare_tx_descr(q, 0, tx_next_segs(q) == NULL);
+
+    //The last descriptor holds the reference that keeps the whole chain
+    //  alive until it's been sent.
+    pbuf_ref(p);
+    last->pbuf = p;
+
+    #if STIF_PTP
+    //The timestamp is written back to the last descriptor, which keeps a
+    //  reference to the whole frame for the callback.
+    if (tx_timestamp_cb != NULL) {
+        pbuf_ref(p);
+        last->pbuf2 = p;
+        first->Status |= ETH_DMATxDesc_TTSE;
+    }
+    #endif
+
+    first->Status |= ETH_DMATxDesc_OWN;
+    tx_free_descs -= segs;
+    stats.tx_frames++;
+    stats.tx_class[cls].frames++;
+    hist_add(stats.tx_occupancy, STIF_NUM_TX_DMA_DESC - tx_free_descs,
+             STIF_NUM_TX_DMA_DESC);
+
+    if (tx_queues[cls].rate)
+        tx_queues[cls].tokens -= p->tot_len;
+
+    //Every frame queued between two stif_loop passes shares a single poll
+    //  demand, issued by tx_flush.
+    tx_kick_pending = 1;
+}
+
+static int tx_schedule(void)
+{
+    int sent = 0;
+
+    //Strict priority, but a class held back by its token bucket doesn't
+    //  block the ones below it.
+    for (int cls = 0; cls < STIF_TX_CLASSES; cls++) {
+        struct tx_queue *q = &tx_queues[cls];
+
+        while (q->count) {
+            struct pbuf *p = q->p[q->head];
+            int segs = tx_descs(p);
+
+            if (!tx_can_send(cls, segs))
+                break;
+
+            cycles_add(&stats.tx_class[cls].queue_delay, q->stamp[q->head]);
+            q->head = (q->head + 1) % STIF_TX_QUEUE_LEN;
+            q->count--;
+
+            tx_submit(p, segs, cls);
+            pbuf_free(p);
+            sent++;
+        }
+    }
+
+    return sent;
+}
+
+static err_t low_level_output(struct netif *netif, struct pbuf *p)
+{
+    int cls = tx_classify(p);
+    struct tx_queue *q = &tx_queues[cls];
+
+    if ((p = tx_bounce(p)) == NULL) {
+        stats.tx_class[cls].dropped++;
+        return ERR_MEM;
+    }
+
+    int segs = tx_descs(p);
+
+    tx_schedule();
+
+    if (q->count == 0 && tx_can_send(cls, segs)) {
+        tx_submit(p, segs, cls);
+        pbuf_free(p);
+        return ERR_OK;
+    }
+
+    if (segs > tx_free_descs)
+        stats.tx_ring_full++;
+
+    if (q->count == STIF_TX_QUEUE_LEN) {
+        stats.tx_class[cls].dropped++;
+        pbuf_free(p);
+        return ERR_MEM;
+    }
+
+    int idx = (q->head + q->count) % STIF_TX_QUEUE_LEN;
+    q->p[idx] = p;
+    q->stamp[idx] = cycles_now();
+    q->count++;
+    stats.tx_class[cls].queued++;
+
+    return ERR_OK;
+}
+
+err_t stif_output_raw(struct netif *netif, struct pbuf *p, int cls)
+{
+    if (!tx_class_valid(cls))
+        return ERR_ARG;
+
+    //Raw frames skip classification and the software queues: they either
+    //  go straight into the ring or the caller has to try again later.
+    if ((p = tx_bounce(p)) == NULL)
+        return ERR_MEM;
+
+    int segs = tx_descs(p);
+
+    tx_schedule();
+
+    if (!tx_can_send(cls, segs)) {
+        if (segs > tx_free_descs)
+            stats.tx_ring_full++;
+        pbuf_free(p);
+        return ERR_MEM;
+    }
+
+    tx_submit(p, segs, cls);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void mdio_start(void)
+{
+    struct mdio_op *op = &mdio_queue[mdio_head];
+
+    int regval = ETH->MACMIIAR;
+    regval &= ~(ETH_MACMIIAR_MR | ETH_MACMIIAR_MW);
+    regval |= op->reg << 6;
+    regval |= ETH_MACMIIAR_MB;
+
+    if (op->write) {
+        ETH->MACMIIDR = op->value;
+        regval |= ETH_MACMIIAR_MW;
+    }
+
+    ETH->MACMIIAR = regval;
+}
+
+static int mdio_submit(int phy_reg, int write, int value, mdio_done_fn done)
+{
+    if (mdio_count == STIF_MDIO_QUEUE_LEN)
+        return 0;
+
+    struct mdio_op *op;
+    op = &mdio_queue[(mdio_head + mdio_count) % STIF_MDIO_QUEUE_LEN];
+    op->reg = phy_reg;
+    op->write = write;
+    op->value = value;
+    op->done = done;
+
+    if (mdio_count++ == 0)
+        mdio_start();
+
+    return 1;
+}
+
+static int mdio_read(int phy_reg, mdio_done_fn done)
+{
+    return mdio_submit(phy_reg, 0, 0, done);
+}
+
+static int mdio_poll(void)
+{
+    if (mdio_count == 0 || (ETH->MACMIIAR & ETH_MACMIIAR_MB))
+        return 0;
+
+    //Grab the result before the next transaction can overwrite it
+    int value = ETH->MACMIIDR & 0xFFFF;
+    mdio_done_fn done = mdio_queue[mdio_head].done;
+
+    mdio_head = (mdio_head + 1) % STIF_MDIO_QUEUE_LEN;
+    if (--mdio_count)
+        mdio_start();
+
+    if (done != NULL)
+        done(value);
+
+    return 1;
+}
+
+static void setup_speed_and_duplex(int mode)
+{
+    mode &= PHY_CTRL_MODE;
 
     int regval = ETH->MACCR;
     regval &= ~(ETH_MACCR_DM | ETH_MACCR_FES);
@@ -399,151 +1743,639 @@ static void setup_speed_and_duplex(void)
     ETH->MACCR = regval;
 }
 
+static void setup_flow_control(int partner)
+{
+    uint32_t fcr = 0;
+
+    #if STIF_FLOW_CONTROL
+    //We only advertise symmetric PAUSE so both directions are enabled
+    //  if the link partner supports it too (IEEE 802.3 Annex 28B).
+    if ((ETH->MACCR & ETH_MACCR_DM) &&
+        (partner & PHY_LINK_PARTNER_SYM_PAUSE))
+    {
+        LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE,
+                    ("stif_input: flow control enabled\n"));
+        fcr = ETH_MACFCR_TFCE | ETH_MACFCR_RFCE;
+    }
+    #endif
+
+    int_disable(ETH_IRQn);
+    flow_control = fcr != 0;
+    rx_paused = 0;
+    ETH->MACFCR = fcr;
+    int_enable(ETH_IRQn);
+}
+
+#if STIF_FLOW_CONTROL
+//Called at the start of each stif_loop pass. Pausing is mostly left to
+//  the interrupt handler, but this also catches a ring left short of
+//  buffers by an empty pool, and releases the link partner once the ring
+//  has been re-armed.
+static void update_flow_control(void)
+{
+    if (!flow_control)
+        return;
+
+    int armed = rx_armed_descs();
+    if (rx_paused ? armed < STIF_PAUSE_HIGH_WATER :
+        armed > STIF_PAUSE_LOW_WATER)
+        return;
+
+    //MACFCR is shared with the interrupt handler
+    int_disable(ETH_IRQn);
+
+    if (!rx_paused) {
+        rx_pause_check();
+    } else if (send_pause(0)) {
+        rx_paused = 0;
+        stats.tx_pause_resumes++;
+    }
+
+    int_enable(ETH_IRQn);
+}
+#endif
+
+#if STIF_FLOW_CONTROL && STIF_PAUSE_FORWARD
+static int is_pause_frame(struct pbuf *p)
+{
+    u8_t *hdr = p->payload;
+    return hdr[12] == 0x88 && hdr[13] == 0x08 &&
+        hdr[14] == 0x00 && hdr[15] == 0x01;
+}
+#endif
+
+static void phy_link_partner_done(int partner)
+{
+    setup_flow_control(partner);
+    netif_set_link_up(phy_netif);
+}
+
+static void phy_mode_done(int mode)
+{
+    setup_speed_and_duplex(mode);
+
+    //There's always room as this transaction was just dequeued
+    mdio_read(PHY_REG_LINK_PARTNER, phy_link_partner_done);
+}
+
+static void phy_interrupt_done(int status)
+{
+    if (status & PHY_IF_LINK_UP)
+        phy_link_status = LINK_UP;
+
+    if (status & PHY_IF_LINK_DOWN)
+        phy_link_status = LINK_DOWN;
+}
+
 __attribute__((__interrupt__))
 static void phy_interrupt(void)
 {
-    hw_eth_rmii_mdint_irq_clear();
-    int status = phy_read_reg(PHY_REG_INTERRUPT);
+    hw_eth_rmii_mdint_irq_clear();
+    phy_event = 1;
+}
+
+static void init_phy_interrupt(void)
+{
+    int_register(ETH_RMII_MDINT_IRQ, phy_interrupt);
+    int_enable(ETH_RMII_MDINT_IRQ);
+
+    phy_write_reg(PHY_REG_INTERRUPT,
+                  (PHY_IEN_LINK_UP |
+                   PHY_IEN_LINK_DOWN));
+}
+
+err_t stif_init(struct netif *netif)
+{
+    err_t ret;
+
+    LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+#if LWIP_NETIF_HOSTNAME
+    /* Initialize interface hostname */
+    netif->hostname = "lwip";
+#endif /* LWIP_NETIF_HOSTNAME */
+
+    netif->name[0] = 's';
+    netif->name[1] = 't';
+    netif->output = etharp_output;
+    netif->linkoutput = low_level_output;
+
+    phy_netif = netif;
+
+    if ((ret = mac_init()) != ERR_OK)
+        return ret;
+
+    init_phy_interrupt();
+
+    /* initialize the hardware */
+    low_level_init(netif);
+
+    return ERR_OK;
+}
+
+static struct pbuf *rx_copybreak_frame(struct pbuf *p)
+{
+    if (p->tot_len >= rx_copybreak) {
+        stats.rx_zerocopy++;
+        return p;
+    }
+
+    struct pbuf *q = NULL;
+    if (!fault_hit(STIF_FAULT_PBUF_ALLOC))
+        q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (q == NULL) {
+        stats.rx_copybreak_failed++;
+        return p;
+    }
+
+    pbuf_copy(q, p);
+
+    //This re-arms the DMA buffer
+    pbuf_free(p);
+
+    stats.rx_copybreak++;
+    return q;
+}
+
+static int rx_frame_error(uint32_t status, uint32_t ext_status, int length)
+{
+    struct stif_rx_errors *err = &stats.rx_errors;
+
+    #if STIF_PTP
+    //With timestamping enabled this bit flags a valid timestamp instead
+    //  of an IP header error (which is still in the extended status).
+    status &= ~ETH_DMARxDesc_TSV;
+    #endif
+
+    //Checksum errors are only reported through the extended status
+    if (!(status & ETH_DMARxDesc_ESA))
+        ext_status = 0;
+
+    if (!(status & ETH_DMARxDesc_ES) &&
+        !(ext_status & (ETH_DMAPTPRxDesc_IPHE | ETH_DMAPTPRxDesc_IPPE)))
+    {
+        if (length >= SIZEOF_ETH_HDR + 4)
+            return 0;
+
+        err->runt++;
+        return 1;
+    }
+
+    if (status & ETH_DMARxDesc_DE)
+        err->descriptor++;
+    if (status & ETH_DMARxDesc_OE)
+        err->overflow++;
+    if (status & ETH_DMARxDesc_CE)
+        err->crc++;
+    if (status & ETH_DMARxDesc_RE)
+        err->receive++;
+    if (status & ETH_DMARxDesc_RWT)
+        err->watchdog++;
+    if (status & ETH_DMARxDesc_LC)
+        err->late_collision++;
+    if (status & ETH_DMARxDesc_LE)
+        err->length++;
+    if ((status & ETH_DMARxDesc_IPV4HCE) ||
+        (ext_status & ETH_DMAPTPRxDesc_IPHE))
+        err->ip_header++;
+    if (ext_status & ETH_DMAPTPRxDesc_IPPE)
+        err->ip_payload++;
+
+    return 1;
+}
+
+#if !STIF_RX_ISR_HARVEST
+static struct pbuf *rx_take_bufs(struct dma_desc *desc, int length)
+{
+    struct pbuf *p = desc->pbuf;
+    desc->pbuf = NULL;
+
+    if (length > RX_DESC_BUF_SIZE)
+        length = RX_DESC_BUF_SIZE;
+
+#if STIF_RX_SPLIT_BUFFERS
+    //Short frames leave the large buffer on the descriptor
+    if (length > STIF_RX_SMALL_BUF_SIZE) {
+        struct pbuf *large = desc->pbuf2;
+        desc->pbuf2 = NULL;
+
+        large->tot_len = large->len = length - STIF_RX_SMALL_BUF_SIZE;
+        p->tot_len = p->len = STIF_RX_SMALL_BUF_SIZE;
+        pbuf_cat(p, large);
+
+        return p;
+    }
+#endif
+
+    p->tot_len = p->len = length;
+    return p;
+}
+#endif
+
+static void policer_init(struct rx_policer *pol, u32_t rate, u32_t burst)
+{
+    pol->rate = rate;
+    pol->per_cycle = tokens_per_cycle(rate);
+    pol->burst = burst ? burst : 1;
+    pol->tokens = pol->burst;
+    pol->last_fill = DWT->CYCCNT;
+}
+
+static int policer_take(struct rx_policer *pol)
+{
+    //As for the transmit buckets, the time stamp only moves on once a
+    //  whole frame has been earned.
+    uint32_t now = DWT->CYCCNT;
+    u32_t earned = tokens_earned(now, pol->last_fill, pol->per_cycle);
+
+    if (earned) {
+        pol->last_fill = now;
+        pol->tokens += earned;
+        if (pol->tokens > (s32_t) pol->burst)
+            pol->tokens = pol->burst;
+    }
+
+    if (pol->tokens <= 0)
+        return 0;
+
+    pol->tokens--;
+    return 1;
+}
+
+static int rx_dst_type(const u8_t *hdr)
+{
+    if (!(hdr[0] & 1))
+        return STIF_RX_DST_UNICAST;
+    if (memcmp(hdr, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) == 0)
+        return STIF_RX_DST_BROADCAST;
+    return STIF_RX_DST_MULTICAST;
+}
+
+static int rx_rule_match(const struct stif_rx_rule *r, struct pbuf *p)
+{
+    u8_t *hdr = p->payload;
+    u16_t type = (hdr[12] << 8) | hdr[13];
 
-    if (status & PHY_IF_LINK_UP)
-        phy_link_status = LINK_UP;
+    if (r->dst && !(r->dst & rx_dst_type(hdr)))
+        return 0;
+    if (r->ethtype && r->ethtype != type)
+        return 0;
+    if (!r->ip_proto && !r->port)
+        return 1;
+
+    if (type != ETHTYPE_IP || p->len < SIZEOF_ETH_HDR + 20)
+        return 0;
 
+    u8_t *iph = hdr + SIZEOF_ETH_HDR;
+    if (r->ip_proto && iph[9] != r->ip_proto)
+        return 0;
+    if (!r->port)
+        return 1;
 
-    if (status & PHY_IF_LINK_DOWN)
-        phy_link_status = LINK_DOWN;
+    //Only the first fragment carries the ports
+    int hlen = (iph[0] & 0xF) * 4;
+    if ((iph[9] != IP_PROTO_UDP && iph[9] != IP_PROTO_TCP) ||
+        ((iph[6] & 0x1F) | iph[7]) || p->len < SIZEOF_ETH_HDR + hlen + 4)
+        return 0;
 
+    return ((iph[hlen + 2] << 8) | iph[hlen + 3]) == r->port;
 }
 
-static void init_phy_interrupt(void)
+//Returns 1 if the frame should be dropped
+static int rx_police(struct pbuf *p)
 {
-    int_register(ETH_RMII_MDINT_IRQ, phy_interrupt);
-    int_enable(ETH_RMII_MDINT_IRQ);
+    for (int i = 0; i < rx_num_rules; i++) {
+        struct rx_rule *r = &rx_rules[i];
+        if (!rx_rule_match(&r->rule, p))
+            continue;
 
-    phy_write_reg(PHY_REG_INTERRUPT,
-                  (PHY_IEN_LINK_UP |
-                   PHY_IEN_LINK_DOWN));
-}
+        stats.rx_rules[i].matched++;
+        if (policer_take(&r->pol))
+            return 0;
 
-err_t stif_init(struct netif *netif)
-{
-    err_t ret;
+        stats.rx_rules[i].dropped++;
+        return 1;
+    }
 
-    LWIP_ASSERT("netif != NULL", (netif != NULL));
+    if (!rx_storm.rate || rx_dst_type(p->payload) == STIF_RX_DST_UNICAST ||
+        policer_take(&rx_storm))
+        return 0;
 
-#if LWIP_NETIF_HOSTNAME
-    /* Initialize interface hostname */
-    netif->hostname = "lwip";
-#endif /* LWIP_NETIF_HOSTNAME */
+    stats.rx_storm_dropped++;
+    return 1;
+}
 
-    netif->name[0] = 's';
-    netif->name[1] = 't';
-    netif->output = etharp_output;
-    netif->linkoutput = low_level_output;
+static int rx_dispatch(struct pbuf *p, struct netif *netif)
+{
+    u8_t *hdr = p->payload;
+    u16_t type = (hdr[12] << 8) | hdr[13];
 
-    if ((ret = mac_init()) != ERR_OK)
-        return ret;
+    for (int i = 0; i < STIF_RX_HANDLERS; i++) {
+        struct rx_handler *h = &rx_handlers[i];
 
-    init_phy_interrupt();
+        if (h->fn == NULL || (h->ethtype && h->ethtype != type) ||
+            (h->match_dst && memcmp(hdr, h->dst, ETHARP_HWADDR_LEN) != 0))
+            continue;
 
-    /* initialize the hardware */
-    low_level_init(netif);
+        if (h->fn(p, netif, h->arg)) {
+            stats.rx_handled++;
+            return 1;
+        }
+    }
 
-    return ERR_OK;
+    return 0;
 }
 
 static int recv_rxdma_buffer(struct netif *netif)
 {
     static struct pbuf *first;
 
-    if (rx_cur_dma_desc->Status & ETH_DMARxDesc_OWN)
+    #if STIF_RX_ISR_HARVEST
+    u32_t tail = rx_harvest_tail;
+    if (tail == rx_harvest_head)
+        return 0;
+
+    struct rx_slot *slot = &rx_harvest_slots[tail % STIF_RX_HARVEST_LEN];
+    struct pbuf *p = slot->p;
+    uint32_t status = slot->status;
+    uint32_t ext_status = slot->ext_status;
+
+    #if STIF_PTP
+    struct stif_timestamp ts = {
+        .sec = slot->ts_high,
+        .nsec = slot->ts_low & ETH_PTPTSLR_STSS,
+    };
+    #endif
+
+    //Hand the slot back before the interrupt handler needs it
+    __sync_synchronize();
+    rx_harvest_tail = tail + 1;
+    #else
+    uint32_t status = rx_cur_dma_desc->Status;
+    uint32_t ext_status = rx_cur_dma_desc->ExtendedStatus;
+
+    if (status & ETH_DMARxDesc_OWN)
         return 0;
 
+    //The ring has been emptied and is waiting to be refilled
     if (rx_cur_dma_desc->pbuf == NULL)
+        return 0;
+    #endif
+
+    if ((status & ETH_DMARxDesc_LS) && fault_hit(STIF_FAULT_RX_DESC_ERROR))
+        status |= ETH_DMARxDesc_ES | ETH_DMARxDesc_DE;
+
+    //Frames spanning several descriptors fill every buffer but the last
+    //  one completely. The frame length in the last descriptor covers the
+    //  whole frame (including the CRC).
+    int length = RX_DESC_BUF_SIZE;
+    if (status & ETH_DMARxDesc_LS) {
+        length = (status & ETH_DMARxDesc_FL) >> 16;
+        if (!(status & ETH_DMARxDesc_FS) && first != NULL)
+            length -= first->tot_len;
+    }
+
+    #if STIF_RX_ISR_HARVEST
+    if (length > RX_DESC_BUF_SIZE)
+        length = RX_DESC_BUF_SIZE;
+    p->tot_len = p->len = length;
+    #else
+    #if STIF_PTP
+    struct stif_timestamp ts = {
+        .sec = rx_cur_dma_desc->TimeStampHigh,
+        .nsec = rx_cur_dma_desc->TimeStampLow & ETH_PTPTSLR_STSS,
+    };
+    #endif
+
+    struct pbuf *p = rx_take_bufs(rx_cur_dma_desc, length);
+    rx_cur_dma_desc = rx_next_desc(rx_cur_dma_desc);
+    #endif
+
+    if (status & ETH_DMARxDesc_FS) {
+        if (first != NULL)
+            pbuf_free(first);
+        first = p;
+    } else if (first == NULL) {
+        pbuf_free(p);
+        return 1;
+    } else {
+        pbuf_cat(first, p);
+    }
+
+    if (!(status & ETH_DMARxDesc_LS))
+        return 1;
+
+    //Bad frames are dropped here, which recycles their buffers straight
+    //  back into the ring.
+    if (rx_frame_error(status, ext_status, first->tot_len)) {
+        stats.rx_dropped++;
+        pbuf_free(first);
+        first = NULL;
+        return 1;
+    }
+
+    #if STIF_FLOW_CONTROL && STIF_PAUSE_FORWARD
+    if (is_pause_frame(first)) {
+        stats.rx_pause_frames++;
+        pbuf_free(first);
+        first = NULL;
         return 1;
+    }
+    #endif
 
-    int frame_length = (rx_cur_dma_desc->Status & ETH_DMARxDesc_FL) >> 16;
+    //Policed frames are dropped before LWIP sees them, recycling their
+    //  buffers straight away.
+    if ((rx_num_rules || rx_storm.rate) && rx_police(first)) {
+        pbuf_free(first);
+        first = NULL;
+        return 1;
+    }
 
-    if (rx_cur_dma_desc->Status & ETH_DMARxDesc_LS)
-        frame_length -=4; // Subtract off the CRC
+    // Trim off the CRC, this may release the last buffer in the chain
+    pbuf_realloc(first, first->tot_len - 4);
 
-    rx_cur_dma_desc->pbuf->tot_len = frame_length;
-    rx_cur_dma_desc->pbuf->len = frame_length;
+    #if STIF_PTP
+    if (rx_timestamp_cb != NULL && (status & ETH_DMARxDesc_TSV))
+        rx_timestamp_cb(first, &ts);
+    #endif
 
-    if (rx_cur_dma_desc->Status & ETH_DMARxDesc_FS)
-        first = rx_cur_dma_desc->pbuf;
-    else
-        pbuf_cat(first, rx_cur_dma_desc->pbuf);
+    stats.rx_frames++;
+    if (((u8_t *) first->payload)[0] & 1) {
+        if (memcmp(first->payload, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) == 0)
+            stats.rx_broadcast++;
+        else
+            stats.rx_multicast++;
+    }
+
+    uint32_t start = cycles_now();
+
+    //Handlers always get the DMA buffers, never a copy
+    if (!rx_num_handlers || !rx_dispatch(first, netif)) {
+        first = rx_copybreak_frame(first);
 
-    if (rx_cur_dma_desc->Status & ETH_DMARxDesc_LS) {
         if (netif->input(first, netif) != ERR_OK)
         {
             LWIP_DEBUGF(NETIF_DEBUG, ("stif_input: IP input error\n"));
             pbuf_free(first);
         }
     }
+    cycles_add(&stats.input_cycles, start);
 
-    rx_cur_dma_desc->pbuf = NULL;
-    rx_cur_dma_desc = rx_cur_dma_desc->Buffer2NextDescAddr;
+    first = NULL;
 
     return 1;
 }
 
-static int realloc_rxdma_buffers(void)
+static int rx_ring_occupancy(void)
 {
-    static struct dma_desc *cur_desc = rx_dma_desc;
-
-    if (cur_desc->Status & ETH_DMARxDesc_OWN) {
-        cur_desc = rx_cur_dma_desc;
-        return 0;
+    #if STIF_RX_ISR_HARVEST
+    return rx_harvest_head - rx_harvest_tail;
+    #else
+    struct dma_desc *desc = rx_cur_dma_desc;
+    int count = 0;
+
+    while (count < STIF_NUM_RX_DMA_DESC && desc->pbuf != NULL &&
+           !(desc->Status & ETH_DMARxDesc_OWN))
+    {
+        desc = rx_next_desc(desc);
+        count++;
     }
 
-    if (cur_desc->pbuf != NULL)
+    return count;
+    #endif
+}
+
+static int recv_rxdma_buffers(struct netif *netif, int budget)
+{
+    int work = 0;
+
+    //Only sampled when there's something to receive, otherwise the idle
+    //  loop would swamp the histogram.
+    int occupancy = rx_ring_occupancy();
+    if (occupancy == 0)
         return 0;
+    hist_add(stats.rx_occupancy, occupancy, RX_QUEUE_LEN);
 
-    cur_desc->pbuf = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
-    if (cur_desc->pbuf == NULL)
-        return 1;
+    while (work < budget && recv_rxdma_buffer(netif))
+        work++;
 
-    cur_desc->Buffer1Addr = cur_desc->pbuf->payload;
-    cur_desc->Status = ETH_DMARxDesc_OWN;
+    if (work == budget)
+        stats.rx_budget_exhausted++;
 
-    if (ETH->DMASR & ETH_DMASR_RBUS) {
-        ETH->DMASR = ETH_DMASR_RBUS;
-        ETH->DMARPDR = 0;
-    }
+    return work;
+}
+
+static void update_mmc_counters(void)
+{
+    struct stif_mmc_counters *mmc = &stats.mmc;
+
+    mmc->rx_good_unicast += ETH->MMCRGUFCR;
+    mmc->rx_crc_errors += ETH->MMCRFCECR;
+    mmc->rx_alignment_errors += ETH->MMCRFAECR;
+    mmc->tx_good += ETH->MMCTGFCR;
+    mmc->tx_single_collision += ETH->MMCTGFSCCR;
+    mmc->tx_multiple_collision += ETH->MMCTGFMSCCR;
+}
 
-    cur_desc = cur_desc->Buffer2NextDescAddr;
+static void update_missed_frames(void)
+{
+    //This register is cleared on read
+    uint32_t mfbocr = ETH->DMAMFBOCR;
 
-    return 1;
+    if (mfbocr & ETH_DMAMFBOCR_OMFC)
+        stats.rx_missed_frames += ETH_DMAMFBOCR_MFC + 1;
+    else
+        stats.rx_missed_frames += mfbocr & ETH_DMAMFBOCR_MFC;
+
+    if (mfbocr & ETH_DMAMFBOCR_OFOC)
+        stats.rx_fifo_overflows += (ETH_DMAMFBOCR_MFA >> 17) + 1;
+    else
+        stats.rx_fifo_overflows += (mfbocr & ETH_DMAMFBOCR_MFA) >> 17;
 }
 
-static int clean_finished_tx_buffers(void)
+//A fatal bus error stops both DMA engines. They're restarted on fresh
+//  rings: the frames in flight are lost, but unlike a full reset the MAC
+//  keeps its address filters, flow control and PTP clock.
+static void dma_restart(void)
 {
-    //The transmit pbufs normally would get freed when the DMA
-    //  descriptor gets to the end of the loop. However, we lazily
-    //  can free them early to not waste so much memory.
-    int ret = 0;
-    static struct dma_desc *cur_desc = tx_dma_desc;
+    stats.dma_bus_errors++;
+    rx_recovery_begin();
 
-    if (!(cur_desc->Status & ETH_DMATxDesc_OWN)) {
-        if (cur_desc->pbuf != NULL)  {
-            ret = 1;
-            pbuf_free(cur_desc->pbuf);
-            cur_desc->pbuf = NULL;
-        }
+    ETH->DMAOMR &= ~(ETH_DMAOMR_ST | ETH_DMAOMR_SR);
+    ETH->DMAOMR |= ETH_DMAOMR_FTF;
+
+    for (int i = 0; i < STIF_NUM_TX_DMA_DESC; i++) {
+        struct dma_desc *desc = &tx_dma_desc[i];
+
+        if (desc->pbuf != NULL)
+            pbuf_free(desc->pbuf);
+        if (desc->pbuf2 != NULL)
+            pbuf_free(desc->pbuf2);
+        desc->pbuf2 = NULL;
     }
 
-    cur_desc = cur_desc->Buffer2NextDescAddr;
-    return ret;
+    init_tx_dma_desc();
+    tx_kick_pending = 0;
+
+    //Freeing the transmitted pbufs may have refilled some receive
+    //  descriptors, so the receive ring is cleared afterwards. Frames
+    //  already harvested are still good and stay queued.
+    #if STIF_RX_ISR_HARVEST
+    int_disable(ETH_IRQn);
+    #endif
+
+    for (int i = 0; i < STIF_NUM_RX_DMA_DESC; i++) {
+        struct dma_desc *desc = &rx_dma_desc[i];
+
+        desc->Status = 0;
+        if (desc->pbuf != NULL)
+            rx_buf_put(desc->pbuf);
+        if (desc->pbuf2 != NULL)
+            rx_buf_put(desc->pbuf2);
+        desc->pbuf = NULL;
+        desc->pbuf2 = NULL;
+    }
+
+    ETH->DMARDLAR = (uint32_t) rx_dma_desc;
+    rx_cur_dma_desc = &rx_dma_desc[0];
+    rx_refill_dma_desc = &rx_dma_desc[0];
+
+    #if STIF_RX_ISR_HARVEST
+    int_enable(ETH_IRQn);
+    #endif
+
+    realloc_rxdma_buffers();
+
+    ETH->DMAOMR |= ETH_DMAOMR_ST | ETH_DMAOMR_SR;
 }
 
 int stif_loop(struct netif *netif)
 {
+    if (fault_hit(STIF_FAULT_DMA_BUS_ERROR))
+        dma_error = 1;
+
+    if (dma_error) {
+        dma_error = 0;
+        dma_restart();
+    }
+
+    //The event is taken before the status is read so an interrupt that
+    //  arrives meanwhile flags it again instead of being lost
+    int_disable(ETH_RMII_MDINT_IRQ);
+    int event = phy_event;
+    phy_event = 0;
+    int_enable(ETH_RMII_MDINT_IRQ);
+
+    if (event && !mdio_read(PHY_REG_INTERRUPT, phy_interrupt_done))
+        phy_event = 1;
+
+    //The link is only reported up once the negotiated mode has been read
+    //  back from the PHY and the MAC configured to match.
     if (phy_link_status == LINK_UP) {
-        LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE, ("stif_input: link up\n"));
-        setup_speed_and_duplex();
-        netif_set_link_up(netif);
-        phy_link_status = NO_CHANGE;
+        if (mdio_read(PHY_REG_CONTROLLER, phy_mode_done)) {
+            LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE, ("stif_input: link up\n"));
+            phy_link_status = NO_CHANGE;
+        }
     } else if (phy_link_status == LINK_DOWN) {
         LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE, ("stif_input: link down\n"));
         netif_set_link_down(netif);
@@ -551,9 +2383,350 @@ int stif_loop(struct netif *netif)
         phy_link_status = NO_CHANGE;
     }
 
-    int ret = recv_rxdma_buffer(netif);
-    ret |= clean_finished_tx_buffers();
-    ret |= realloc_rxdma_buffers();
+    //Frames sent since the last pass, from the timers or the application,
+    //  go out before this pass's receive batch adds more
+    tx_flush();
+    #if STIF_FLOW_CONTROL
+    update_flow_control();
+    #endif
+
+    uint32_t start = cycles_now();
+    int ret = recv_rxdma_buffers(netif, rx_budget);
+    if (ret)
+        cycles_add(&stats.rx_cycles, start);
+
+    start = cycles_now();
+    int work = clean_finished_tx_buffers();
+    if (work)
+        cycles_add(&stats.tx_clean_cycles, start);
+    ret += work;
+
+    //Frames sent while processing the receive batch and those released by
+    //  the scheduler share one poll demand
+    ret += tx_schedule();
+    tx_flush();
+
+    start = cycles_now();
+    work = realloc_rxdma_buffers();
+    if (work)
+        cycles_add(&stats.refill_cycles, start);
+    ret += work;
+
+    update_missed_frames();
+    ret += mdio_poll();
 
     return ret;
 }
+
+void stif_set_rx_budget(int budget)
+{
+    rx_budget = budget > 0 ? budget : 1;
+}
+
+#if STIF_PTP
+void stif_get_time(struct stif_timestamp *ts)
+{
+    //Re-read if the seconds rolled over while reading the nanoseconds
+    do {
+        ts->sec = ETH->PTPTSHR;
+        ts->nsec = ETH->PTPTSLR & ETH_PTPTSLR_STSS;
+    } while (ts->sec != ETH->PTPTSHR);
+}
+
+void stif_set_rx_timestamp_callback(stif_timestamp_fn fn)
+{
+    rx_timestamp_cb = fn;
+}
+
+void stif_set_tx_timestamp_callback(stif_timestamp_fn fn)
+{
+    tx_timestamp_cb = fn;
+}
+#endif
+
+err_t stif_set_tx_rate(int cls, u32_t bytes_per_sec, u32_t burst)
+{
+    if (!tx_class_valid(cls))
+        return ERR_ARG;
+
+    struct tx_queue *q = &tx_queues[cls];
+
+    //Default to 10ms worth of data, but at least one full frame
+    if (burst == 0)
+        burst = bytes_per_sec / 100;
+    if (burst < 1514)
+        burst = 1514;
+
+    q->rate = bytes_per_sec;
+    q->per_cycle = tokens_per_cycle(bytes_per_sec);
+    q->burst = burst;
+    q->tokens = burst;
+    q->last_fill = DWT->CYCCNT;
+
+    return ERR_OK;
+}
+
+err_t stif_set_tx_udp_port_class(u16_t port, int cls)
+{
+    int free = -1;
+
+    if (!tx_class_valid(cls))
+        return ERR_ARG;
+
+    for (int i = 0; i < STIF_TX_PORT_RULES; i++) {
+        if (tx_port_class[i].port == port) {
+            tx_port_class[i].cls = cls;
+            return ERR_OK;
+        }
+
+        if (free < 0 && tx_port_class[i].port == 0)
+            free = i;
+    }
+
+    if (free < 0)
+        return ERR_MEM;
+
+    tx_port_class[free].port = port;
+    tx_port_class[free].cls = cls;
+    return ERR_OK;
+}
+
+err_t stif_add_rx_handler(u16_t ethtype, const u8_t *dst,
+                          stif_rx_handler_fn fn, void *arg)
+{
+    for (int i = 0; i < STIF_RX_HANDLERS; i++) {
+        struct rx_handler *h = &rx_handlers[i];
+        if (h->fn != NULL)
+            continue;
+
+        h->ethtype = ethtype;
+        h->match_dst = dst != NULL;
+        if (dst != NULL)
+            memcpy(h->dst, dst, ETHARP_HWADDR_LEN);
+        h->arg = arg;
+        h->fn = fn;
+        rx_num_handlers++;
+
+        return ERR_OK;
+    }
+
+    return ERR_MEM;
+}
+
+void stif_remove_rx_handler(stif_rx_handler_fn fn, void *arg)
+{
+    for (int i = 0; i < STIF_RX_HANDLERS; i++) {
+        if (rx_handlers[i].fn == fn && rx_handlers[i].arg == arg) {
+            rx_handlers[i].fn = NULL;
+            rx_num_handlers--;
+        }
+    }
+}
+
+//Returns the rule's index in the rx_rules stats, or -1 if the table is full
+int stif_add_rx_rule(const struct stif_rx_rule *rule)
+{
+    if (rx_num_rules == STIF_RX_RULES)
+        return -1;
+
+    struct rx_rule *r = &rx_rules[rx_num_rules];
+    r->rule = *rule;
+    policer_init(&r->pol, rule->rate, rule->burst);
+    stats.rx_rules[rx_num_rules].matched = 0;
+    stats.rx_rules[rx_num_rules].dropped = 0;
+
+    return rx_num_rules++;
+}
+
+void stif_clear_rx_rules(void)
+{
+    rx_num_rules = 0;
+}
+
+void stif_set_rx_storm_rate(u32_t rate, u32_t burst)
+{
+    policer_init(&rx_storm, rate, burst);
+}
+
+void stif_set_irq_moderation(int usecs)
+{
+    irq_moderation = usecs;
+
+    if (usecs == STIF_IRQ_MODERATION_ADAPTIVE)
+        adapt_irq_moderation(stats.rx_rate);
+    else
+        set_rx_coalesce(usecs);
+}
+
+static void rx_watchdog(void)
+{
+    //Reception suspends when the DMA finds a descriptor it doesn't own and
+    //  only resumes on a poll demand. If the descriptor it stopped at (the
+    //  next one to be received) has been armed since, a demand was missed.
+    if ((ETH->DMASR & ETH_DMASR_RBUS) &&
+        (rx_cur_dma_desc->Status & ETH_DMARxDesc_OWN))
+    {
+        stats.rx_stall_recoveries++;
+        rx_poll_demand();
+    }
+}
+
+static void tx_watchdog(void)
+{
+    static u32_t last_cleaned;
+    static int idle;
+
+    if (tx_free_descs == STIF_NUM_TX_DMA_DESC || tx_cleaned != last_cleaned) {
+        last_cleaned = tx_cleaned;
+        idle = 0;
+        return;
+    }
+
+    if (++idle * STIF_TMR_INTERVAL < STIF_TX_TIMEOUT)
+        return;
+
+    idle = 0;
+    stats.tx_stall_recoveries++;
+    tx_poll_demand();
+}
+
+void stif_tmr(void)
+{
+    static u32_t last_frames, last_irqs;
+
+    u32_t frames = stats.rx_frames - last_frames;
+    u32_t irqs = stats.irqs - last_irqs;
+    last_frames = stats.rx_frames;
+    last_irqs = stats.irqs;
+
+    stats.rx_rate = frames * 1000 / STIF_TMR_INTERVAL;
+    stats.irq_rate = irqs * 1000 / STIF_TMR_INTERVAL;
+    stats.rx_frames_per_irq = irqs ? frames * 10 / irqs : 0;
+
+    update_mmc_counters();
+
+    if (irq_moderation == STIF_IRQ_MODERATION_ADAPTIVE)
+        adapt_irq_moderation(stats.rx_rate);
+
+    #if STIF_FLOW_CONTROL
+    //Refresh the PAUSE before it expires if we still haven't caught up
+    int_disable(ETH_IRQn);
+    if (rx_paused && send_pause(pause_time()))
+        stats.tx_pause_frames++;
+    int_enable(ETH_IRQn);
+    #endif
+
+    rx_watchdog();
+    tx_watchdog();
+}
+
+void stif_set_rx_copybreak(int bytes)
+{
+    rx_copybreak = bytes;
+}
+
+#if STIF_FAULT_INJECTION
+//Makes the next count occurrences of a fault happen, zero cancels it
+void stif_inject_fault(int fault, u32_t count)
+{
+    if (fault >= 0 && fault < STIF_FAULTS)
+        fault_count[fault] = count;
+}
+#endif
+
+const struct stif_stats *stif_get_stats(void)
+{
+    update_mmc_counters();
+    return &stats;
+}
+
+#if LWIP_STATS_DISPLAY
+static void hist_display(const char *name, const u32_t *hist)
+{
+    LWIP_PLATFORM_DIAG(("%s:", name));
+    for (int i = 0; i < STIF_HIST_BUCKETS; i++)
+        LWIP_PLATFORM_DIAG((" %"U32_F, hist[i]));
+    LWIP_PLATFORM_DIAG(("\n"));
+}
+
+static void cycles_display(const char *name, const struct stif_cycles *c)
+{
+    u32_t avg = c->calls ? c->total / c->calls : 0;
+
+    LWIP_PLATFORM_DIAG(("%s cycles: calls %"U32_F" avg %"U32_F" max %"U32_F"\n",
+                        name, c->calls, avg, c->max));
+}
+
+static void pool_display(const char *name, const struct stif_pool_stats *p)
+{
+    LWIP_PLATFORM_DIAG(("%s: size %"U32_F" free %"U32_F" low %"U32_F
+                        " starved %"U32_F"\n", name, p->size, p->free,
+                        p->low_watermark, p->starved));
+}
+
+void stif_stats_display(void)
+{
+    const struct stif_stats *s = stif_get_stats();
+    const struct stif_rx_errors *e = &s->rx_errors;
+
+    LWIP_PLATFORM_DIAG(("\nSTIF\n"));
+    LWIP_PLATFORM_DIAG(("rx: frames %"U32_F" dropped %"U32_F" missed %"U32_F
+                        " fifo overflows %"U32_F"\n", s->rx_frames,
+                        s->rx_dropped, s->rx_missed_frames,
+                        s->rx_fifo_overflows));
+    LWIP_PLATFORM_DIAG(("rx errors: crc %"U32_F" receive %"U32_F
+                        " overflow %"U32_F" descriptor %"U32_F" runt %"U32_F
+                        " ip hdr %"U32_F" ip payload %"U32_F"\n", e->crc,
+                        e->receive, e->overflow, e->descriptor, e->runt,
+                        e->ip_header, e->ip_payload));
+    LWIP_PLATFORM_DIAG(("rx: zerocopy %"U32_F" copybreak %"U32_F
+                        " (failed %"U32_F") budget exhausted %"U32_F
+                        " refill failures %"U32_F"\n", s->rx_zerocopy,
+                        s->rx_copybreak, s->rx_copybreak_failed,
+                        s->rx_budget_exhausted, s->rx_refill_failures));
+    #if STIF_RX_ISR_HARVEST
+    LWIP_PLATFORM_DIAG(("rx: harvest queue full %"U32_F"\n",
+                        s->rx_harvest_full));
+    #endif
+    LWIP_PLATFORM_DIAG(("rx: handled %"U32_F"\n", s->rx_handled));
+    for (int i = 0; i < rx_num_rules; i++)
+        LWIP_PLATFORM_DIAG(("rx: rule %d matched %"U32_F" dropped %"U32_F"\n",
+                            i, s->rx_rules[i].matched, s->rx_rules[i].dropped));
+    LWIP_PLATFORM_DIAG(("rx: storm dropped %"U32_F"\n", s->rx_storm_dropped));
+    LWIP_PLATFORM_DIAG(("irqs %"U32_F" (%"U32_F"/s) rx %"U32_F"/s"
+                        " moderation %"U32_F"us\n", s->irqs, s->irq_rate,
+                        s->rx_rate, s->irq_moderation_usecs));
+    pool_display("rx pool", &s->rx_pool);
+    pool_display("rx small pool", &s->rx_small_pool);
+    LWIP_PLATFORM_DIAG(("tx: frames %"U32_F" ring full %"U32_F
+                        " bounced %"U32_F"\n", s->tx_frames, s->tx_ring_full,
+                        s->tx_bounced));
+    LWIP_PLATFORM_DIAG(("pause: rx %"U32_F" tx %"U32_F" resume %"U32_F"\n",
+                        s->rx_pause_frames, s->tx_pause_frames,
+                        s->tx_pause_resumes));
+    hist_display("rx occupancy", s->rx_occupancy);
+    hist_display("tx occupancy", s->tx_occupancy);
+    cycles_display("rx", &s->rx_cycles);
+    cycles_display("input", &s->input_cycles);
+    cycles_display("tx clean", &s->tx_clean_cycles);
+    cycles_display("refill", &s->refill_cycles);
+    LWIP_PLATFORM_DIAG(("recovery: rx stalls %"U32_F" tx stalls %"U32_F
+                        " bus errors %"U32_F" faults injected %"U32_F"\n",
+                        s->rx_stall_recoveries, s->tx_stall_recoveries,
+                        s->dma_bus_errors, s->faults_injected));
+    cycles_display("rx recovery", &s->rx_recovery_cycles);
+    for (int i = 0; i < STIF_TX_CLASSES; i++) {
+        const struct stif_tx_class_stats *c = &s->tx_class[i];
+        LWIP_PLATFORM_DIAG(("tx class %d: frames %"U32_F" queued %"U32_F
+                            " dropped %"U32_F" throttled %"U32_F"\n", i,
+                            c->frames, c->queued, c->dropped, c->throttled));
+        cycles_display("  queue delay", &c->queue_delay);
+    }
+    LWIP_PLATFORM_DIAG(("mmc: rx unicast %"U32_F" crc %"U32_F
+                        " alignment %"U32_F" tx %"U32_F" single col %"U32_F
+                        " multiple col %"U32_F"\n", s->mmc.rx_good_unicast,
+                        s->mmc.rx_crc_errors, s->mmc.rx_alignment_errors,
+                        s->mmc.tx_good, s->mmc.tx_single_collision,
+                        s->mmc.tx_multiple_collision));
+}
+#endif
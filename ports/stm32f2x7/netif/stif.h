@@ -46,8 +46,222 @@
 #include "lwip/err.h"
 #include "lwip/netif.h"
 
+//Maximum number of receive descriptors handled per call to stif_loop
+#ifndef STIF_RX_BUDGET
+#define STIF_RX_BUDGET 8
+#endif
+
+//Interval (in ms) at which stif_tmr should be called
+#ifndef STIF_TMR_INTERVAL
+#define STIF_TMR_INTERVAL 100
+#endif
+
+//Receive interrupt moderation delay in microseconds; 0 interrupts on
+//  every frame and STIF_IRQ_MODERATION_ADAPTIVE picks the delay from the
+//  measured packet rate.
+#define STIF_IRQ_MODERATION_ADAPTIVE -1
+
+#ifndef STIF_IRQ_MODERATION
+#define STIF_IRQ_MODERATION 0
+#endif
+
+//Hardware (IEEE 1588) timestamping of received and transmitted frames
+#ifndef STIF_PTP
+#define STIF_PTP 0
+#endif
+
+//Measure the cycles spent in each stage of stif_loop with the DWT cycle
+//  counter
+#ifndef STIF_CYCLE_STATS
+#define STIF_CYCLE_STATS 0
+#endif
+
+//Compile in the hooks stif_inject_fault uses to exercise the driver's
+//  error recovery
+#ifndef STIF_FAULT_INJECTION
+#define STIF_FAULT_INJECTION 0
+#endif
+
+//Ring occupancy histograms: bucket n counts samples where the occupancy
+//  was at least n/(STIF_HIST_BUCKETS-1) of the ring, the last bucket is a
+//  completely full ring.
+#define STIF_HIST_BUCKETS 8
+
+struct stif_cycles {
+    u32_t calls;
+    u32_t max;
+    unsigned long long total;
+};
+
+//Transmit priority classes, lower numbers are sent first
+#define STIF_TX_CLASS_CONTROL 0
+#define STIF_TX_CLASS_NORMAL  1
+#define STIF_TX_CLASS_BULK    2
+#define STIF_TX_CLASSES       3
+
+//Faults for stif_inject_fault
+#define STIF_FAULT_RX_BUF        0   //Receive pool allocations fail
+#define STIF_FAULT_PBUF_ALLOC    1   //pbuf_alloc fails
+#define STIF_FAULT_RX_DESC_ERROR 2   //Received frames are flagged as bad
+#define STIF_FAULT_POLL_DEMAND   3   //DMA poll demands are lost
+#define STIF_FAULT_DMA_BUS_ERROR 4   //The DMA reports a fatal bus error
+#define STIF_FAULTS              5
+
+struct stif_tx_class_stats {
+    u32_t frames;
+    u32_t queued;
+    u32_t dropped;
+    u32_t throttled;
+    struct stif_cycles queue_delay;
+};
+
+//Receive policing rules, checked in order before frames reach LWIP. Zero
+//  fields match anything; the first matching rule's token bucket decides
+//  whether the frame is kept.
+#ifndef STIF_RX_RULES
+#define STIF_RX_RULES 8
+#endif
+
+#define STIF_RX_DST_UNICAST   1
+#define STIF_RX_DST_MULTICAST 2
+#define STIF_RX_DST_BROADCAST 4
+
+struct stif_rx_rule {
+    u8_t dst;           //STIF_RX_DST_* flags
+    u8_t ip_proto;
+    u16_t ethtype;
+    u16_t port;         //UDP or TCP destination port
+    u32_t rate;         //Frames per second, zero drops every match
+    u32_t burst;        //Frames
+};
+
+struct stif_rx_rule_stats {
+    u32_t matched;
+    u32_t dropped;
+};
+
+struct stif_mmc_counters {
+    u32_t rx_good_unicast;
+    u32_t rx_crc_errors;
+    u32_t rx_alignment_errors;
+    u32_t tx_good;
+    u32_t tx_single_collision;
+    u32_t tx_multiple_collision;
+};
+
+struct stif_pool_stats {
+    u32_t size;
+    u32_t free;
+    u32_t low_watermark;
+    u32_t starved;
+};
+
+struct stif_rx_errors {
+    u32_t crc;
+    u32_t receive;
+    u32_t overflow;
+    u32_t descriptor;
+    u32_t watchdog;
+    u32_t late_collision;
+    u32_t length;
+    u32_t runt;
+    u32_t ip_header;
+    u32_t ip_payload;
+};
+
+struct stif_stats {
+    u32_t rx_frames;
+    u32_t rx_handled;           //Taken by a handler instead of LWIP
+    struct stif_rx_rule_stats rx_rules[STIF_RX_RULES];
+    u32_t rx_storm_dropped;
+    u32_t rx_budget_exhausted;
+    u32_t rx_zerocopy;
+    u32_t rx_copybreak;
+    u32_t rx_copybreak_failed;  //No PBUF_RAM, passed up uncopied
+    u32_t rx_dropped;
+    u32_t rx_multicast;
+    u32_t rx_broadcast;
+    struct stif_rx_errors rx_errors;
+    u32_t rx_missed_frames;
+    u32_t rx_fifo_overflows;
+    u32_t irqs;
+    u32_t irq_rate;
+    u32_t rx_rate;
+    u32_t rx_frames_per_irq;   //In tenths
+    u32_t irq_moderation_usecs;
+    struct stif_pool_stats rx_pool;
+    struct stif_pool_stats rx_small_pool;
+    u32_t mc_perfect_groups;
+    u32_t mc_hash_groups;
+    u32_t rx_pause_frames;     //Only with STIF_PAUSE_FORWARD
+    u32_t tx_pause_frames;
+    u32_t tx_pause_resumes;
+    u32_t tx_frames;
+    u32_t tx_ring_full;
+    u32_t tx_bounced;           //Long chains copied into one buffer
+    struct stif_tx_class_stats tx_class[STIF_TX_CLASSES];
+    u32_t rx_refill_failures;
+    u32_t rx_harvest_full;      //ISR found the harvest queue full
+    u32_t rx_stall_recoveries;
+    u32_t tx_stall_recoveries;
+    u32_t dma_bus_errors;
+    u32_t faults_injected;
+    struct stif_cycles rx_recovery_cycles;
+    u32_t rx_occupancy[STIF_HIST_BUCKETS];
+    u32_t tx_occupancy[STIF_HIST_BUCKETS];
+    struct stif_cycles rx_cycles;
+    struct stif_cycles input_cycles;
+    struct stif_cycles tx_clean_cycles;
+    struct stif_cycles refill_cycles;
+    struct stif_mmc_counters mmc;
+};
+
+//Receive handlers get frames (without the CRC) before LWIP does. They
+//  return 1 if they took the frame, in which case they must free it, or 0
+//  to pass it on to netif->input.
+typedef int (*stif_rx_handler_fn)(struct pbuf *p, struct netif *netif,
+                                  void *arg);
+
+#if STIF_PTP
+struct stif_timestamp {
+    u32_t sec;
+    u32_t nsec;
+};
+
+typedef void (*stif_timestamp_fn)(struct pbuf *p,
+                                  const struct stif_timestamp *ts);
+#endif
+
 err_t stif_init(struct netif *netif);
 err_t stif_input(struct netif *netif);
 int stif_loop(struct netif *netif);
+void stif_tmr(void);
+
+void stif_set_rx_budget(int budget);
+void stif_set_rx_copybreak(int bytes);
+void stif_set_irq_moderation(int usecs);
+err_t stif_set_tx_rate(int cls, u32_t bytes_per_sec, u32_t burst);
+err_t stif_set_tx_udp_port_class(u16_t port, int cls);
+err_t stif_add_rx_handler(u16_t ethtype, const u8_t *dst,
+                          stif_rx_handler_fn fn, void *arg);
+void stif_remove_rx_handler(stif_rx_handler_fn fn, void *arg);
+int stif_add_rx_rule(const struct stif_rx_rule *rule);
+void stif_clear_rx_rules(void);
+void stif_set_rx_storm_rate(u32_t rate, u32_t burst);
+err_t stif_output_raw(struct netif *netif, struct pbuf *p, int cls);
+const struct stif_stats *stif_get_stats(void);
+#if LWIP_STATS_DISPLAY
+void stif_stats_display(void);
+#endif
+
+#if STIF_FAULT_INJECTION
+void stif_inject_fault(int fault, u32_t count);
+#endif
+
+#if STIF_PTP
+void stif_get_time(struct stif_timestamp *ts);
+void stif_set_rx_timestamp_callback(stif_timestamp_fn fn);
+void stif_set_tx_timestamp_callback(stif_timestamp_fn fn);
+#endif
 
 #endif
@@ -55,6 +55,7 @@ struct dma_desc {
     uint32_t   TimeStampLow;
     uint32_t   TimeStampHigh;
     struct pbuf *pbuf;
+    struct pbuf *pbuf2;
 };
 
 #define ETH_DMATxDesc_OWN                     ((uint32_t)0x80000000)
@@ -87,6 +88,9 @@ struct dma_desc {
 #define ETH_DMATxDesc_UF                      ((uint32_t)0x00000002)
 #define ETH_DMATxDesc_DB                      ((uint32_t)0x00000001)
 
+#define ETH_DMATxDesc_TBS2  ((uint32_t)0x1FFF0000)
+#define ETH_DMATxDesc_TBS1  ((uint32_t)0x00001FFF)
+
 #define ETH_DMARxDesc_OWN         ((uint32_t)0x80000000)
 #define ETH_DMARxDesc_AFM         ((uint32_t)0x40000000)
 #define ETH_DMARxDesc_FL          ((uint32_t)0x3FFF0000)
@@ -106,6 +110,8 @@ struct dma_desc {
 #define ETH_DMARxDesc_DBE         ((uint32_t)0x00000004)
 #define ETH_DMARxDesc_CE          ((uint32_t)0x00000002)
 #define ETH_DMARxDesc_MAMPCE      ((uint32_t)0x00000001)
+#define ETH_DMARxDesc_ESA         ((uint32_t)0x00000001)
+#define ETH_DMARxDesc_TSV         ((uint32_t)0x00000080)
 
 #define ETH_DMARxDesc_DIC   ((uint32_t)0x80000000)
 #define ETH_DMARxDesc_RBS2  ((uint32_t)0x1FFF0000)
@@ -113,5 +119,15 @@ struct dma_desc {
 #define ETH_DMARxDesc_RCH   ((uint32_t)0x00004000)
 #define ETH_DMARxDesc_RBS1  ((uint32_t)0x00001FFF)
 
+#define ETH_DMAPTPRxDesc_PTPV     ((uint32_t)0x00002000)
+#define ETH_DMAPTPRxDesc_PTPFT    ((uint32_t)0x00001000)
+#define ETH_DMAPTPRxDesc_PTPMT    ((uint32_t)0x00000F00)
+#define ETH_DMAPTPRxDesc_IPV6PR   ((uint32_t)0x00000080)
+#define ETH_DMAPTPRxDesc_IPV4PR   ((uint32_t)0x00000040)
+#define ETH_DMAPTPRxDesc_IPCB     ((uint32_t)0x00000020)
+#define ETH_DMAPTPRxDesc_IPPE     ((uint32_t)0x00000010)
+#define ETH_DMAPTPRxDesc_IPHE     ((uint32_t)0x00000008)
+#define ETH_DMAPTPRxDesc_IPPT     ((uint32_t)0x00000007)
+
 
 #endif
@@ -0,0 +1,303 @@
+/****************************************************************//**
+ *
+ * @file stif_pktgen.c
+ *
+ * @brief    Packet generator and loopback benchmark for the stif driver
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "lwip/pbuf.h"
+#include "netif/etharp.h"
+#include "stif.h"
+#include "stif_pktgen.h"
+
+#include "config.h"
+#include <stmlib/clock.h>
+
+#include <string.h>
+
+//Number of pre-built frames, they're sent round robin
+#ifndef STIF_PKTGEN_BUFS
+#define STIF_PKTGEN_BUFS 4
+#endif
+
+//Maximum frames queued per call to stif_pktgen_poll
+#ifndef STIF_PKTGEN_BURST
+#define STIF_PKTGEN_BURST 8
+#endif
+
+//How long (in ms) to wait for outstanding frames after the last one is sent
+#ifndef STIF_PKTGEN_DRAIN_MS
+#define STIF_PKTGEN_DRAIN_MS 100
+#endif
+
+static struct {
+    struct netif *netif;
+    struct stif_pktgen_config cfg;
+    struct pbuf *bufs[STIF_PKTGEN_BUFS];
+    int cur;
+    int set_loopback;
+
+    u32_t hclk;
+    u32_t interval;
+    uint32_t next;
+    uint32_t last;
+
+    //All in cycles since the run started
+    unsigned long long elapsed;
+    unsigned long long last_tx;
+    unsigned long long last_rx;
+    unsigned long long busy;
+    unsigned long long driver_start;
+} gen;
+
+static struct stif_pktgen_stats stats;
+
+static unsigned long long driver_cycles(void)
+{
+    //Only stages that did some work are measured, so idle polling isn't
+    //  counted as busy.
+    const struct stif_stats *s = stif_get_stats();
+    return (s->rx_cycles.total + s->tx_clean_cycles.total +
+            s->refill_cycles.total);
+}
+
+static void update_elapsed(void)
+{
+    uint32_t now = DWT->CYCCNT;
+    gen.elapsed += now - gen.last;
+    gen.last = now;
+}
+
+static u32_t per_sec(u32_t count, unsigned long long cycles)
+{
+    if (!cycles)
+        return 0;
+    return (unsigned long long) count * gen.hclk / cycles;
+}
+
+static void update_stats(void)
+{
+    update_elapsed();
+
+    unsigned long long busy = gen.busy + driver_cycles() - gen.driver_start;
+
+    stats.elapsed_ms = gen.elapsed * 1000 / gen.hclk;
+    stats.tx_pps = per_sec(stats.sent, gen.last_tx);
+    stats.rx_pps = per_sec(stats.received, gen.last_rx);
+    stats.rx_kbps = ((unsigned long long) stats.rx_pps *
+                     (gen.cfg.size + 4) * 8 / 1000);
+    stats.headroom = 0;
+    if (busy < gen.elapsed)
+        stats.headroom = 100 - busy * 100 / gen.elapsed;
+}
+
+static int pktgen_rx(struct pbuf *p, struct netif *netif, void *arg)
+{
+    stats.received++;
+    gen.last_rx = gen.elapsed + (uint32_t) (DWT->CYCCNT - gen.last);
+    pbuf_free(p);
+
+    return 1;
+}
+
+static void free_bufs(void)
+{
+    for (int i = 0; i < STIF_PKTGEN_BUFS; i++) {
+        //Frames still in the transmit ring hold their own reference
+        if (gen.bufs[i] != NULL)
+            pbuf_free(gen.bufs[i]);
+        gen.bufs[i] = NULL;
+    }
+}
+
+static err_t build_bufs(struct netif *netif, const u8_t *dst, int size)
+{
+    for (int i = 0; i < STIF_PKTGEN_BUFS; i++) {
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, size, PBUF_RAM);
+        if (p == NULL) {
+            free_bufs();
+            return ERR_MEM;
+        }
+
+        u8_t *frame = p->payload;
+        memcpy(frame, dst, ETHARP_HWADDR_LEN);
+        memcpy(&frame[6], netif->hwaddr, ETHARP_HWADDR_LEN);
+        frame[12] = STIF_PKTGEN_ETHTYPE >> 8;
+        frame[13] = STIF_PKTGEN_ETHTYPE & 0xFF;
+
+        for (int j = SIZEOF_ETH_HDR; j < size; j++)
+            frame[j] = j + i;
+
+        gen.bufs[i] = p;
+    }
+
+    return ERR_OK;
+}
+
+err_t stif_pktgen_start(struct netif *netif,
+                        const struct stif_pktgen_config *cfg)
+{
+    if (gen.netif != NULL)
+        return ERR_INPROGRESS;
+
+    if (cfg->size < 60 || cfg->size > 1514)
+        return ERR_VAL;
+
+    err_t err = build_bufs(netif, cfg->dst ? cfg->dst : netif->hwaddr,
+                           cfg->size);
+    if (err != ERR_OK)
+        return err;
+
+    err = stif_add_rx_handler(STIF_PKTGEN_ETHTYPE, NULL, pktgen_rx, NULL);
+    if (err != ERR_OK) {
+        free_bufs();
+        return err;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    gen.cfg = *cfg;
+    gen.cur = 0;
+    gen.hclk = clock_get_freq(ETH);
+    gen.interval = cfg->rate ? gen.hclk / cfg->rate : 0;
+
+    gen.set_loopback = cfg->loopback && !(ETH->MACCR & ETH_MACCR_LM);
+    if (gen.set_loopback)
+        ETH->MACCR |= ETH_MACCR_LM;
+
+    gen.netif = netif;
+
+    gen.elapsed = gen.last_tx = gen.last_rx = gen.busy = 0;
+    gen.driver_start = driver_cycles();
+    gen.last = gen.next = DWT->CYCCNT;
+
+    return ERR_OK;
+}
+
+void stif_pktgen_stop(void)
+{
+    if (gen.netif == NULL)
+        return;
+
+    update_stats();
+
+    if (gen.set_loopback)
+        ETH->MACCR &= ~ETH_MACCR_LM;
+
+    stif_remove_rx_handler(pktgen_rx, NULL);
+    gen.netif = NULL;
+    free_bufs();
+}
+
+int stif_pktgen_running(void)
+{
+    return gen.netif != NULL;
+}
+
+static int done_sending(void)
+{
+    return gen.cfg.count && stats.sent >= gen.cfg.count;
+}
+
+int stif_pktgen_poll(void)
+{
+    if (gen.netif == NULL)
+        return 0;
+
+    update_elapsed();
+
+    if (done_sending()) {
+        //Finished once everything has come back or the stragglers are
+        //  given up on.
+        if (stats.received >= stats.sent ||
+            gen.elapsed - gen.last_tx >=
+            (unsigned long long) gen.hclk * STIF_PKTGEN_DRAIN_MS / 1000)
+            stif_pktgen_stop();
+        return 0;
+    }
+
+    uint32_t start = gen.last;
+    int sent = 0;
+
+    //Fall behind by no more than a burst, rather than catching up in one
+    //  long burst after a stall.
+    if (gen.interval && (int32_t) (start - gen.next) >
+        (int32_t) (gen.interval * STIF_PKTGEN_BURST))
+        gen.next = start;
+
+    while (sent < STIF_PKTGEN_BURST && !done_sending()) {
+        if (gen.interval && (int32_t) (DWT->CYCCNT - gen.next) < 0)
+            break;
+
+        struct pbuf *p = gen.bufs[gen.cur];
+        if (stif_output_raw(gen.netif, p, STIF_TX_CLASS_NORMAL) != ERR_OK) {
+            stats.tx_busy++;
+            break;
+        }
+
+        gen.cur = (gen.cur + 1) % STIF_PKTGEN_BUFS;
+        gen.next += gen.interval;
+        stats.sent++;
+        sent++;
+    }
+
+    if (sent) {
+        uint32_t cycles = DWT->CYCCNT - start;
+        gen.busy += cycles;
+        gen.last_tx = gen.elapsed + cycles;
+    }
+
+    return sent;
+}
+
+const struct stif_pktgen_stats *stif_pktgen_get_stats(void)
+{
+    if (gen.netif != NULL)
+        update_stats();
+
+    return &stats;
+}
+
+#if LWIP_STATS_DISPLAY
+void stif_pktgen_display(void)
+{
+    const struct stif_pktgen_stats *s = stif_pktgen_get_stats();
+
+    LWIP_PLATFORM_DIAG(("\nPKTGEN%s\n", gen.netif ? " (running)" : ""));
+    LWIP_PLATFORM_DIAG(("sent %"U32_F" received %"U32_F" tx busy %"U32_F
+                        " in %"U32_F"ms\n", s->sent, s->received,
+                        s->tx_busy, s->elapsed_ms));
+    LWIP_PLATFORM_DIAG(("tx %"U32_F"pps rx %"U32_F"pps %"U32_F"kbit/s"
+                        " headroom %"U32_F"%%\n", s->tx_pps, s->rx_pps,
+                        s->rx_kbps, s->headroom));
+}
+#endif
@@ -0,0 +1,78 @@
+/****************************************************************//**
+ *
+ * @file stif_pktgen.h
+ *
+ * @brief    Packet generator and loopback benchmark for the stif driver
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __STIF_PKTGEN_H__
+#define __STIF_PKTGEN_H__
+
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+//Ethertype of the generated frames (IEEE 802 local experimental)
+#ifndef STIF_PKTGEN_ETHTYPE
+#define STIF_PKTGEN_ETHTYPE 0x88B5
+#endif
+
+struct stif_pktgen_config {
+    int size;           //Frame length without the CRC (60 to 1514 bytes)
+    u32_t rate;         //Frames per second, 0 sends as fast as possible
+    u32_t count;        //Frames to send, 0 runs until stopped
+    int loopback;       //Loop the frames back inside the MAC
+    const u8_t *dst;    //Destination address, NULL for our own
+};
+
+struct stif_pktgen_stats {
+    u32_t sent;
+    u32_t received;
+    u32_t tx_busy;      //Times the transmit queue was full
+    u32_t elapsed_ms;
+    u32_t tx_pps;
+    u32_t rx_pps;
+    u32_t rx_kbps;      //Including the CRC
+    u32_t headroom;     //Percentage of CPU time not spent in the driver
+};
+
+err_t stif_pktgen_start(struct netif *netif,
+                        const struct stif_pktgen_config *cfg);
+void stif_pktgen_stop(void);
+int stif_pktgen_running(void);
+int stif_pktgen_poll(void);
+const struct stif_pktgen_stats *stif_pktgen_get_stats(void);
+#if LWIP_STATS_DISPLAY
+void stif_pktgen_display(void);
+#endif
+
+#endif
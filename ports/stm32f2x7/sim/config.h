@@ -0,0 +1,58 @@
+/****************************************************************//**
+ *
+ * @file config.h
+ *
+ * @brief    Configuration for the host simulation
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <devices/stm32f2xx.h>
+
+#define TICK_FREQ 100
+
+#define ETH_RMII_MDINT_IRQ  EXTI3_IRQn
+
+static inline void hw_eth_rmii_mdint_irq_clear(void)
+{
+}
+
+//The driver reads its MAC address from the OTP area
+extern unsigned char sim_otp_hwaddr[6];
+extern unsigned char sim_unique_id[12];
+
+#define STIF_OTP_HWADDR sim_otp_hwaddr
+#define STIF_UNIQUE_ID  sim_unique_id
+
+#endif
@@ -0,0 +1,284 @@
+/****************************************************************//**
+ *
+ * @file stm32f2xx.h
+ *
+ * @brief    Host simulation replacement for the STM32F2xx device header
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __SIM_STM32F2XX_H__
+#define __SIM_STM32F2XX_H__
+
+#include <stdint.h>
+
+//Only what the stif driver uses is provided. Every access to ETH or DWT
+//  goes through the simulation so it can emulate the side effects of
+//  register accesses (see sim_eth.c).
+
+#define __IO volatile
+
+typedef enum {
+    EXTI3_IRQn = 9,
+    ETH_IRQn = 61,
+    SIM_NUM_IRQS = 82,
+} IRQn_Type;
+
+//The register layout doesn't matter here, only the names
+typedef struct {
+    __IO uint32_t MACCR;
+    __IO uint32_t MACFFR;
+    __IO uint32_t MACHTHR;
+    __IO uint32_t MACHTLR;
+    __IO uint32_t MACMIIAR;
+    __IO uint32_t MACMIIDR;
+    __IO uint32_t MACFCR;
+    __IO uint32_t MACVLANTR;
+    __IO uint32_t MACRWUFFR;
+    __IO uint32_t MACPMTCSR;
+    __IO uint32_t MACSR;
+    __IO uint32_t MACIMR;
+    __IO uint32_t MACA0HR;
+    __IO uint32_t MACA0LR;
+    __IO uint32_t MACA1HR;
+    __IO uint32_t MACA1LR;
+    __IO uint32_t MACA2HR;
+    __IO uint32_t MACA2LR;
+    __IO uint32_t MACA3HR;
+    __IO uint32_t MACA3LR;
+    __IO uint32_t MMCCR;
+    __IO uint32_t MMCRIR;
+    __IO uint32_t MMCTIR;
+    __IO uint32_t MMCRIMR;
+    __IO uint32_t MMCTIMR;
+    __IO uint32_t MMCTGFSCCR;
+    __IO uint32_t MMCTGFMSCCR;
+    __IO uint32_t MMCTGFCR;
+    __IO uint32_t MMCRFCECR;
+    __IO uint32_t MMCRFAECR;
+    __IO uint32_t MMCRGUFCR;
+    __IO uint32_t PTPTSCR;
+    __IO uint32_t PTPSSIR;
+    __IO uint32_t PTPTSHR;
+    __IO uint32_t PTPTSLR;
+    __IO uint32_t PTPTSHUR;
+    __IO uint32_t PTPTSLUR;
+    __IO uint32_t PTPTSAR;
+    __IO uint32_t PTPTTHR;
+    __IO uint32_t PTPTTLR;
+    __IO uint32_t PTPTSSR;
+    __IO uint32_t DMABMR;
+    __IO uint32_t DMATPDR;
+    __IO uint32_t DMARPDR;
+    __IO uint32_t DMARDLAR;
+    __IO uint32_t DMATDLAR;
+    __IO uint32_t DMASR;
+    __IO uint32_t DMAOMR;
+    __IO uint32_t DMAIER;
+    __IO uint32_t DMAMFBOCR_latch[1];
+    __IO uint32_t DMARSWTR;
+    __IO uint32_t DMACHTDR;
+    __IO uint32_t DMACHRDR;
+    __IO uint32_t DMACHTBAR;
+    __IO uint32_t DMACHRBAR;
+} ETH_TypeDef;
+
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    __IO uint32_t DHCSR;
+    __IO uint32_t DCRSR;
+    __IO uint32_t DCRDR;
+    __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+ETH_TypeDef *sim_eth_regs(void);
+DWT_Type *sim_dwt_regs(void);
+extern CoreDebug_Type sim_core_debug;
+
+//DMAMFBOCR is cleared when it's read, which a plain member can't show.
+//  Reading it evaluates sim_eth_read_mfbocr (always 0) as the index, which
+//  latches the counters into the register and starts them again.
+uint32_t sim_eth_read_mfbocr(void);
+#define DMAMFBOCR DMAMFBOCR_latch[sim_eth_read_mfbocr()]
+
+#define ETH       (sim_eth_regs())
+#define DWT       (sim_dwt_regs())
+#define CoreDebug (&sim_core_debug)
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk     (1UL << 0)
+
+#define ETH_MACCR_WD                 ((uint32_t)0x00800000)
+#define ETH_MACCR_JD                 ((uint32_t)0x00400000)
+#define ETH_MACCR_CSD                ((uint32_t)0x00010000)
+#define ETH_MACCR_FES                ((uint32_t)0x00004000)
+#define ETH_MACCR_ROD                ((uint32_t)0x00002000)
+#define ETH_MACCR_LM                 ((uint32_t)0x00001000)
+#define ETH_MACCR_DM                 ((uint32_t)0x00000800)
+#define ETH_MACCR_IPCO               ((uint32_t)0x00000400)
+#define ETH_MACCR_RD                 ((uint32_t)0x00000200)
+#define ETH_MACCR_APCS               ((uint32_t)0x00000080)
+#define ETH_MACCR_TE                 ((uint32_t)0x00000008)
+#define ETH_MACCR_RE                 ((uint32_t)0x00000004)
+#define ETH_MACFFR_RA                ((uint32_t)0x80000000)
+#define ETH_MACFFR_HPF               ((uint32_t)0x00000400)
+#define ETH_MACFFR_SAF               ((uint32_t)0x00000200)
+#define ETH_MACFFR_SAIF              ((uint32_t)0x00000100)
+#define ETH_MACFFR_PCF               ((uint32_t)0x000000C0)
+#define ETH_MACFFR_PCF_ForwardAll    ((uint32_t)0x00000080)
+#define ETH_MACFFR_BFD               ((uint32_t)0x00000020)
+#define ETH_MACFFR_PAM               ((uint32_t)0x00000010)
+#define ETH_MACFFR_DAIF              ((uint32_t)0x00000008)
+#define ETH_MACFFR_HM                ((uint32_t)0x00000004)
+#define ETH_MACFFR_HU                ((uint32_t)0x00000002)
+#define ETH_MACFFR_PM                ((uint32_t)0x00000001)
+#define ETH_MACMIIAR_PA              ((uint32_t)0x0000F800)
+#define ETH_MACMIIAR_MR              ((uint32_t)0x000007C0)
+#define ETH_MACMIIAR_CR              ((uint32_t)0x0000001C)
+#define ETH_MACMIIAR_CR_Div42        ((uint32_t)0x00000000)
+#define ETH_MACMIIAR_CR_Div62        ((uint32_t)0x00000004)
+#define ETH_MACMIIAR_CR_Div16        ((uint32_t)0x00000008)
+#define ETH_MACMIIAR_CR_Div26        ((uint32_t)0x0000000C)
+#define ETH_MACMIIAR_MW              ((uint32_t)0x00000002)
+#define ETH_MACMIIAR_MB              ((uint32_t)0x00000001)
+#define ETH_MACFCR_PT                ((uint32_t)0xFFFF0000)
+#define ETH_MACFCR_ZQPD              ((uint32_t)0x00000080)
+#define ETH_MACFCR_PLT               ((uint32_t)0x00000030)
+#define ETH_MACFCR_PLT_Minus4        ((uint32_t)0x00000000)
+#define ETH_MACFCR_PLT_Minus28       ((uint32_t)0x00000010)
+#define ETH_MACFCR_PLT_Minus144      ((uint32_t)0x00000020)
+#define ETH_MACFCR_PLT_Minus256      ((uint32_t)0x00000030)
+#define ETH_MACFCR_UPFD              ((uint32_t)0x00000008)
+#define ETH_MACFCR_RFCE              ((uint32_t)0x00000004)
+#define ETH_MACFCR_TFCE              ((uint32_t)0x00000002)
+#define ETH_MACFCR_FCBBPA            ((uint32_t)0x00000001)
+#define ETH_MACA1HR_AE               ((uint32_t)0x80000000)
+#define ETH_MMCCR_MCF                ((uint32_t)0x00000008)
+#define ETH_MMCCR_ROR                ((uint32_t)0x00000004)
+#define ETH_MMCCR_CSR                ((uint32_t)0x00000002)
+#define ETH_MMCCR_CR                 ((uint32_t)0x00000001)
+#define ETH_MMCRIMR_RGUFM            ((uint32_t)0x00020000)
+#define ETH_MMCRIMR_RFAEM            ((uint32_t)0x00000040)
+#define ETH_MMCRIMR_RFCEM            ((uint32_t)0x00000020)
+#define ETH_MMCTIMR_TGFM             ((uint32_t)0x00200000)
+#define ETH_MMCTIMR_TGFMSCM          ((uint32_t)0x00008000)
+#define ETH_MMCTIMR_TGFSCM           ((uint32_t)0x00004000)
+#define ETH_PTPTSCR_TSCNT            ((uint32_t)0x00030000)
+#define ETH_PTPTSSR_TSSMRME          ((uint32_t)0x00008000)
+#define ETH_PTPTSSR_TSSEME           ((uint32_t)0x00004000)
+#define ETH_PTPTSSR_TSSIPV4FE        ((uint32_t)0x00002000)
+#define ETH_PTPTSSR_TSSIPV6FE        ((uint32_t)0x00001000)
+#define ETH_PTPTSSR_TSSPTPOEFE       ((uint32_t)0x00000800)
+#define ETH_PTPTSSR_TSPTPPSV2E       ((uint32_t)0x00000400)
+#define ETH_PTPTSSR_TSSSR            ((uint32_t)0x00000200)
+#define ETH_PTPTSSR_TSSARFE          ((uint32_t)0x00000100)
+#define ETH_PTPTSCR_TSARU            ((uint32_t)0x00000020)
+#define ETH_PTPTSCR_TSITE            ((uint32_t)0x00000010)
+#define ETH_PTPTSCR_TSSTU            ((uint32_t)0x00000008)
+#define ETH_PTPTSCR_TSSTI            ((uint32_t)0x00000004)
+#define ETH_PTPTSCR_TSFCU            ((uint32_t)0x00000002)
+#define ETH_PTPTSCR_TSE              ((uint32_t)0x00000001)
+#define ETH_PTPTSLUR_TSUPNS          ((uint32_t)0x80000000)
+#define ETH_PTPTSLUR_TSUSS           ((uint32_t)0x7FFFFFFF)
+#define ETH_DMABMR_AAB               ((uint32_t)0x02000000)
+#define ETH_DMABMR_FPM               ((uint32_t)0x01000000)
+#define ETH_DMABMR_USP               ((uint32_t)0x00800000)
+#define ETH_DMABMR_RDP               ((uint32_t)0x007E0000)
+#define ETH_DMABMR_FB                ((uint32_t)0x00010000)
+#define ETH_DMABMR_RTPR              ((uint32_t)0x0000C000)
+#define ETH_DMABMR_RTPR_1_1          ((uint32_t)0x00000000)
+#define ETH_DMABMR_RTPR_2_1          ((uint32_t)0x00004000)
+#define ETH_DMABMR_RTPR_3_1          ((uint32_t)0x00008000)
+#define ETH_DMABMR_RTPR_4_1          ((uint32_t)0x0000C000)
+#define ETH_DMABMR_PBL               ((uint32_t)0x00003F00)
+#define ETH_DMABMR_EDE               ((uint32_t)0x00000080)
+#define ETH_DMABMR_DSL               ((uint32_t)0x0000007C)
+#define ETH_DMABMR_DA                ((uint32_t)0x00000002)
+#define ETH_DMABMR_SR                ((uint32_t)0x00000001)
+#define ETH_DMASR_TSTS               ((uint32_t)0x20000000)
+#define ETH_DMASR_PMTS               ((uint32_t)0x10000000)
+#define ETH_DMASR_MMCS               ((uint32_t)0x08000000)
+#define ETH_DMASR_EBS                ((uint32_t)0x03800000)
+#define ETH_DMASR_TPS                ((uint32_t)0x00700000)
+#define ETH_DMASR_RPS                ((uint32_t)0x000E0000)
+#define ETH_DMASR_NIS                ((uint32_t)0x00010000)
+#define ETH_DMASR_AIS                ((uint32_t)0x00008000)
+#define ETH_DMASR_ERS                ((uint32_t)0x00004000)
+#define ETH_DMASR_FBES               ((uint32_t)0x00002000)
+#define ETH_DMASR_ETS                ((uint32_t)0x00000400)
+#define ETH_DMASR_RWTS               ((uint32_t)0x00000200)
+#define ETH_DMASR_RPSS               ((uint32_t)0x00000100)
+#define ETH_DMASR_RBUS               ((uint32_t)0x00000080)
+#define ETH_DMASR_RS                 ((uint32_t)0x00000040)
+#define ETH_DMASR_TUS                ((uint32_t)0x00000020)
+#define ETH_DMASR_ROS                ((uint32_t)0x00000010)
+#define ETH_DMASR_TJTS               ((uint32_t)0x00000008)
+#define ETH_DMASR_TBUS               ((uint32_t)0x00000004)
+#define ETH_DMASR_TPSS               ((uint32_t)0x00000002)
+#define ETH_DMASR_TS                 ((uint32_t)0x00000001)
+#define ETH_DMAOMR_DTCEFD            ((uint32_t)0x04000000)
+#define ETH_DMAOMR_RSF               ((uint32_t)0x02000000)
+#define ETH_DMAOMR_DFRF              ((uint32_t)0x01000000)
+#define ETH_DMAOMR_TSF               ((uint32_t)0x00200000)
+#define ETH_DMAOMR_FTF               ((uint32_t)0x00100000)
+#define ETH_DMAOMR_TTC               ((uint32_t)0x0001C000)
+#define ETH_DMAOMR_ST                ((uint32_t)0x00002000)
+#define ETH_DMAOMR_FEF               ((uint32_t)0x00000080)
+#define ETH_DMAOMR_FUGF              ((uint32_t)0x00000040)
+#define ETH_DMAOMR_RTC               ((uint32_t)0x00000018)
+#define ETH_DMAOMR_OSF               ((uint32_t)0x00000004)
+#define ETH_DMAOMR_SR                ((uint32_t)0x00000002)
+#define ETH_DMAIER_NISE              ((uint32_t)0x00010000)
+#define ETH_DMAIER_AISE              ((uint32_t)0x00008000)
+#define ETH_DMAIER_ERIE              ((uint32_t)0x00004000)
+#define ETH_DMAIER_FBEIE             ((uint32_t)0x00002000)
+#define ETH_DMAIER_ETIE              ((uint32_t)0x00000400)
+#define ETH_DMAIER_RWTIE             ((uint32_t)0x00000200)
+#define ETH_DMAIER_RPSIE             ((uint32_t)0x00000100)
+#define ETH_DMAIER_RBUIE             ((uint32_t)0x00000080)
+#define ETH_DMAIER_RIE               ((uint32_t)0x00000040)
+#define ETH_DMAIER_TUIE              ((uint32_t)0x00000020)
+#define ETH_DMAIER_ROIE              ((uint32_t)0x00000010)
+#define ETH_DMAIER_TJTIE             ((uint32_t)0x00000008)
+#define ETH_DMAIER_TBUIE             ((uint32_t)0x00000004)
+#define ETH_DMAIER_TPSIE             ((uint32_t)0x00000002)
+#define ETH_DMAIER_TIE               ((uint32_t)0x00000001)
+#define ETH_DMAMFBOCR_OFOC           ((uint32_t)0x10000000)
+#define ETH_DMAMFBOCR_MFA            ((uint32_t)0x0FFE0000)
+#define ETH_DMAMFBOCR_OMFC           ((uint32_t)0x00010000)
+#define ETH_DMAMFBOCR_MFC            ((uint32_t)0x0000FFFF)
+#define ETH_PTPTSLR_STSS             ((uint32_t)0x7FFFFFFF)
+
+#endif
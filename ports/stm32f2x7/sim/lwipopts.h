@@ -0,0 +1,71 @@
+/****************************************************************//**
+ *
+ * @file lwipopts.h
+ *
+ * @brief    LWIP options for the host simulation
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __LWIPOPTS_H__
+#define __LWIPOPTS_H__
+
+#define NO_SYS                     1
+#define NO_SYS_NO_TIMERS           1
+#define LWIP_SOCKET                0
+#define LWIP_NETCONN               0
+
+#define MEM_ALIGNMENT              8
+#define MEM_SIZE                   (64*1024)
+#define MEMP_NUM_PBUF              32
+#define PBUF_POOL_SIZE             16
+#define LWIP_SUPPORT_CUSTOM_PBUF   1
+
+#define LWIP_ARP                   1
+#define LWIP_IGMP                  1
+#define LWIP_DHCP                  0
+#define LWIP_AUTOIP                0
+#define LWIP_TCP                   1
+#define LWIP_UDP                   1
+
+//The MAC's checksum offload is not simulated
+#define CHECKSUM_GEN_IP            1
+#define CHECKSUM_GEN_UDP           1
+#define CHECKSUM_GEN_TCP           1
+
+#define LWIP_STATS                 1
+#define LWIP_STATS_DISPLAY         1
+
+#define STIF_FAULT_INJECTION       1
+#define STIF_CYCLE_STATS           1
+#define STIF_FLOW_CONTROL          1
+
+#endif
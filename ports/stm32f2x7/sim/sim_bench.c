@@ -0,0 +1,731 @@
+/****************************************************************//**
+ *
+ * @file sim_bench.c
+ *
+ * @brief    Benchmark of the stif driver against the simulated MAC
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "sim_eth.h"
+
+#include <lwip/init.h>
+#include <lwip/netif.h>
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+#include <lwip/stats.h>
+#include <netif/etharp.h>
+#include <netif/stif.h>
+#include <netif/stif_pktgen.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FRAME       1518
+#define DISCARD_PORT    9
+
+//Burst allowed over the -S broadcast rate, as STIF_RX_STORM_BURST
+#define STORM_BURST     100
+
+//The latency run sends a probe to the echo port every LAT_EVERY steps
+#define LAT_PORT        7
+#define LAT_EVERY       8
+#define LAT_IDS         4096
+
+#define TOS_CS1         0x20
+#define TOS_CS6         0xC0
+
+static struct netif netif;
+
+static struct {
+    unsigned long frames;
+    unsigned long size;
+    unsigned long burst;
+    int budget;
+    int copybreak;
+    unsigned long hold;
+    unsigned long storm;
+    int echo;
+    int mixed;
+    int no_pause;
+    int latency;
+    int full_stack;
+    int pktgen;
+    const char *read_file;
+    const char *write_file;
+    int fault;
+    unsigned long fault_count;
+} opts = {
+    .frames = 1000000,
+    .size = 64,
+    .burst = 4,
+    .copybreak = -1,
+    .fault = -1,
+    .fault_count = 1000,
+};
+
+static const char *fault_names[STIF_FAULTS] = {
+    [STIF_FAULT_RX_BUF] = "rx_buf",
+    [STIF_FAULT_PBUF_ALLOC] = "pbuf_alloc",
+    [STIF_FAULT_RX_DESC_ERROR] = "rx_desc",
+    [STIF_FAULT_POLL_DEMAND] = "poll_demand",
+    [STIF_FAULT_DMA_BUS_ERROR] = "bus_error",
+};
+
+//Frame sizes of the mixed traffic run, the simple IMIX of 7 small, 4
+//  medium and 1 full sized frame, interleaved
+static const int imix_sizes[] = {
+    64, 576, 64, 64, 1514, 64, 576, 64, 576, 64, 64, 576,
+};
+#define IMIX_LEN (sizeof(imix_sizes) / sizeof(*imix_sizes))
+
+static unsigned long delivered;
+static unsigned long delivered_bcast;
+static FILE *pcap_out;
+
+//Frames kept back from the counting input, as a stack queueing them would
+#define MAX_HOLD        64
+static struct pbuf *held[MAX_HOLD];
+static unsigned long held_count;
+
+//Steps from a probe being handed to the driver until the simulated MAC
+//  sends it, which are frame times with the transmit limit at one
+static struct {
+    int active;
+    unsigned long step;
+    unsigned long sent_at[LAT_IDS];
+    unsigned long sent, received, total, max;
+} lat;
+
+static struct {
+    uint8_t *data;
+    int *len;
+    int count;
+} trace;
+
+static struct {
+    unsigned long calls;
+    double total, max;
+} loop_time;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//The time stif_loop takes is how long the rest of the main loop waits
+static int timed_loop(void)
+{
+    double start = now();
+    int ret = stif_loop(&netif);
+    double t = now() - start;
+
+    loop_time.calls++;
+    loop_time.total += t;
+    if (t > loop_time.max)
+        loop_time.max = t;
+
+    return ret;
+}
+
+static void print_loop_time(void)
+{
+    printf("loop:      %lu calls, avg %.2f us, max %.2f us\n", loop_time.calls,
+           loop_time.calls ? loop_time.total / loop_time.calls * 1e6 : 0.,
+           loop_time.max * 1e6);
+}
+
+static uint16_t ip_checksum(const uint8_t *hdr, int len)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < len; i += 2)
+        sum += (hdr[i] << 8) | hdr[i+1];
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return ~sum;
+}
+
+//A UDP datagram from 10.0.0.1 to the discard port on the interface
+static int make_frame(uint8_t *f, int size)
+{
+    if (size < 60)
+        size = 60;
+    if (size > MAX_FRAME - 4)
+        size = MAX_FRAME - 4;
+
+    memset(f, 0, size);
+    memcpy(f, netif.hwaddr, 6);
+    memcpy(&f[6], "\x02\x00\x00\x00\x00\x01", 6);
+    f[12] = 0x08;
+
+    uint8_t *ip = &f[14];
+    int ip_len = size - 14;
+    ip[0] = 0x45;
+    ip[2] = ip_len >> 8;
+    ip[3] = ip_len;
+    ip[8] = 64;
+    ip[9] = 17;
+    memcpy(&ip[12], "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+    uint16_t csum = ip_checksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum;
+
+    uint8_t *udp = &ip[20];
+    int udp_len = ip_len - 20;
+    udp[0] = 0x30;
+    udp[1] = 0x39;
+    udp[3] = DISCARD_PORT;
+    udp[4] = udp_len >> 8;
+    udp[5] = udp_len;
+
+    return size;
+}
+
+//An outgoing datagram with the given DSCP marking and destination port
+static int make_tx_frame(uint8_t *f, int size, int tos, int port)
+{
+    size = make_frame(f, size);
+
+    uint8_t *ip = &f[14];
+    ip[1] = tos;
+    ip[10] = ip[11] = 0;
+    uint16_t csum = ip_checksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum;
+
+    uint8_t *udp = &ip[20];
+    udp[2] = port >> 8;
+    udp[3] = port;
+
+    return size;
+}
+
+static void pcap_write_header(FILE *f)
+{
+    uint32_t hdr[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1};
+    fwrite(hdr, sizeof(hdr), 1, f);
+}
+
+static void pcap_write(FILE *f, const uint8_t *frame, int len)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    uint32_t hdr[4] = {ts.tv_sec, ts.tv_nsec / 1000, len, len};
+    fwrite(hdr, sizeof(hdr), 1, f);
+    fwrite(frame, len, 1, f);
+}
+
+static int pcap_read(const char *fname)
+{
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) {
+        perror(fname);
+        return -1;
+    }
+
+    uint32_t hdr[6];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[0] != 0xa1b2c3d4 ||
+        hdr[5] != 1)
+    {
+        fprintf(stderr, "%s: not a little endian ethernet pcap file\n", fname);
+        fclose(f);
+        return -1;
+    }
+
+    uint32_t rec[4];
+    uint8_t frame[65536];
+    while (fread(rec, sizeof(rec), 1, f) == 1) {
+        if (rec[2] > sizeof(frame) || fread(frame, rec[2], 1, f) != 1)
+            break;
+
+        //Truncated captures and oversized frames can't be replayed
+        if (rec[2] != rec[3] || rec[2] > MAX_FRAME - 4)
+            continue;
+
+        trace.data = realloc(trace.data, (trace.count + 1) * MAX_FRAME);
+        trace.len = realloc(trace.len, (trace.count + 1) * sizeof(int));
+        memcpy(&trace.data[trace.count * MAX_FRAME], frame, rec[2]);
+        trace.len[trace.count++] = rec[2];
+    }
+
+    fclose(f);
+
+    if (!trace.count) {
+        fprintf(stderr, "%s: no frames\n", fname);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void lat_check(const uint8_t *frame, int len)
+{
+    const uint8_t *udp = &frame[14 + 20];
+
+    if (!lat.active || len < 14 + 20 + 12 || frame[12] != 0x08 ||
+        frame[13] != 0x00 || ((udp[2] << 8) | udp[3]) != LAT_PORT)
+        return;
+
+    uint32_t id;
+    memcpy(&id, &udp[8], sizeof(id));
+
+    unsigned long delay = lat.step - lat.sent_at[id % LAT_IDS];
+    lat.received++;
+    lat.total += delay;
+    if (delay > lat.max)
+        lat.max = delay;
+}
+
+static void tx_frame(const uint8_t *frame, int len, void *arg)
+{
+    lat_check(frame, len);
+
+    if (pcap_out != NULL)
+        pcap_write(pcap_out, frame, len);
+}
+
+//Sends a frame through the driver's classifier and transmit queues
+static err_t send_frame(const uint8_t *frame, int len)
+{
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+    if (p == NULL)
+        return ERR_MEM;
+
+    memcpy(p->payload, frame, len);
+    err_t err = netif.linkoutput(&netif, p);
+    pbuf_free(p);
+
+    return err;
+}
+
+//Used instead of ethernet_input to measure the driver on its own
+static err_t count_input(struct pbuf *p, struct netif *netif)
+{
+    delivered++;
+    if (((uint8_t *) p->payload)[0] & 1)
+        delivered_bcast++;
+
+    //Bounce the frame straight back (zero copy) to load the transmit path
+    if (opts.echo) {
+        uint8_t *f = p->payload;
+        uint8_t tmp[6];
+        memcpy(tmp, f, 6);
+        memcpy(f, &f[6], 6);
+        memcpy(&f[6], tmp, 6);
+        netif->linkoutput(netif, p);
+    }
+
+    //Release the oldest held frame to make room for this one
+    if (opts.hold) {
+        struct pbuf **slot = &held[held_count++ % opts.hold];
+        if (*slot != NULL)
+            pbuf_free(*slot);
+        *slot = p;
+        return ERR_OK;
+    }
+
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void release_held(void)
+{
+    for (unsigned long i = 0; i < opts.hold; i++) {
+        if (held[i] != NULL)
+            pbuf_free(held[i]);
+        held[i] = NULL;
+    }
+}
+
+static void discard_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                         ip_addr_t *addr, u16_t port)
+{
+    delivered++;
+
+    if (opts.echo)
+        udp_sendto(pcb, p, addr, port);
+
+    pbuf_free(p);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n frames] [-s size] [-b burst] [-B budget]\n"
+            "          [-C copybreak] [-k frames] [-S rate] [-t] [-m] [-p]\n"
+            "          [-c] [-l] [-g] [-r in.pcap] [-w out.pcap]\n"
+            "          [-f fault[:count]]\n"
+            "  -n  frames to offer to the MAC (default %lu)\n"
+            "  -s  size of the generated frames (default %lu)\n"
+            "  -b  frames offered per stif_loop (default %lu)\n"
+            "  -B  frames received per stif_loop (default STIF_RX_BUDGET)\n"
+            "  -C  copy frames up to this size (default STIF_RX_COPYBREAK)\n"
+            "  -k  hold on to the last frames received, up to %d, as a\n"
+            "      stack queueing them would\n"
+            "  -S  make every other frame a broadcast and limit broadcasts\n"
+            "      to this many frames per second\n"
+            "  -t  echo every frame back out\n"
+            "  -m  offer a mix of 64, 576 and 1514 byte frames (IMIX)\n"
+            "  -p  the link partner doesn't support PAUSE (no flow control)\n"
+            "  -c  measure the latency of control frames sent behind bulk\n"
+            "      transmit traffic, unmarked and then marked with DSCP\n"
+            "  -l  pass frames through LWIP's stack, not a counting input\n"
+            "  -r  replay the frames in a pcap file instead\n"
+            "  -g  send the frames with stif_pktgen over the MAC loopback\n"
+            "  -w  write the transmitted frames to a pcap file\n"
+            "  -f  inject count (default %lu) faults half way through, one\n"
+            "      of rx_buf, pbuf_alloc, rx_desc, poll_demand or bus_error\n",
+            prog, opts.frames, opts.size, opts.burst, MAX_HOLD,
+            opts.fault_count);
+    exit(1);
+}
+
+static int parse_fault(char *arg)
+{
+    char *count = strchr(arg, ':');
+    if (count != NULL) {
+        *count++ = 0;
+        opts.fault_count = strtoul(count, NULL, 0);
+    }
+
+    for (int i = 0; i < STIF_FAULTS; i++)
+        if (strcmp(arg, fault_names[i]) == 0)
+            return i;
+
+    return -1;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:b:B:C:k:S:tmpclgr:w:f:")) != -1) {
+        switch (c) {
+        case 'n': opts.frames = strtoul(optarg, NULL, 0); break;
+        case 's': opts.size = strtoul(optarg, NULL, 0); break;
+        case 'b': opts.burst = strtoul(optarg, NULL, 0); break;
+        case 'B': opts.budget = strtol(optarg, NULL, 0); break;
+        case 'C': opts.copybreak = strtol(optarg, NULL, 0); break;
+        case 'k': opts.hold = strtoul(optarg, NULL, 0); break;
+        case 'S': opts.storm = strtoul(optarg, NULL, 0); break;
+        case 't': opts.echo = 1; break;
+        case 'm': opts.mixed = 1; break;
+        case 'p': opts.no_pause = 1; break;
+        case 'c': opts.latency = 1; break;
+        case 'l': opts.full_stack = 1; break;
+        case 'g': opts.pktgen = 1; break;
+        case 'r': opts.read_file = optarg; break;
+        case 'w': opts.write_file = optarg; break;
+        case 'f':
+            if ((opts.fault = parse_fault(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if (!opts.burst)
+        opts.burst = 1;
+    if (opts.hold > MAX_HOLD)
+        usage(argv[0]);
+}
+
+static void run_tmr(double *last)
+{
+    double t = now();
+    if (t - *last >= STIF_TMR_INTERVAL / 1000.) {
+        *last = t;
+        stif_tmr();
+    }
+}
+
+static int run_pktgen(void)
+{
+    struct stif_pktgen_config cfg = {
+        .size = opts.size,
+        .count = opts.frames,
+        .loopback = 1,
+    };
+
+    err_t err = stif_pktgen_start(&netif, &cfg);
+    if (err != ERR_OK) {
+        fprintf(stderr, "stif_pktgen_start failed: %d\n", err);
+        return 1;
+    }
+
+    double last_tmr = now();
+    while (stif_pktgen_running()) {
+        stif_pktgen_poll();
+        timed_loop();
+        sim_eth_step();
+        run_tmr(&last_tmr);
+    }
+
+    const struct sim_eth_stats *s = sim_eth_get_stats();
+    printf("mac:       tx %u tbus %u poll demands %u\n",
+           s->tx_frames, s->tx_ring_stalls, s->tx_poll_demands);
+    print_loop_time();
+
+    stif_pktgen_display();
+    stif_stats_display();
+
+    return 0;
+}
+
+//The wire only takes one frame per step, so -b bulk frames per step keep
+//  the transmit ring and queues backed up while the probes are sent. With
+//  marked unset every frame is in the normal class, as if there were no
+//  scheduler.
+static void run_latency_pass(int marked)
+{
+    uint8_t bulk[MAX_FRAME], probe[MAX_FRAME];
+    int bulk_len = make_tx_frame(bulk, opts.size, marked ? TOS_CS1 : 0,
+                                 DISCARD_PORT);
+    int probe_len = make_tx_frame(probe, 64, marked ? TOS_CS6 : 0, LAT_PORT);
+    unsigned long bulk_dropped = 0;
+
+    memset(&lat, 0, sizeof(lat));
+    memset(&loop_time, 0, sizeof(loop_time));
+    lat.active = 1;
+    sim_eth_set_tx_limit(1);
+
+    for (unsigned long offered = 0; offered < opts.frames; lat.step++) {
+        for (unsigned long i = 0; i < opts.burst && offered < opts.frames;
+             i++, offered++)
+        {
+            if (send_frame(bulk, bulk_len) != ERR_OK)
+                bulk_dropped++;
+        }
+
+        if (lat.step % LAT_EVERY == 0) {
+            uint32_t id = lat.sent;
+            memcpy(&probe[14 + 20 + 8], &id, sizeof(id));
+            if (send_frame(probe, probe_len) == ERR_OK)
+                lat.sent_at[lat.sent++ % LAT_IDS] = lat.step;
+        }
+
+        timed_loop();
+        sim_eth_step();
+    }
+
+    //Let the probes still queued go out at the same pace
+    for (int i = 0; i < 10000 && lat.received < lat.sent; i++, lat.step++) {
+        stif_loop(&netif);
+        sim_eth_step();
+    }
+
+    lat.active = 0;
+    sim_eth_set_tx_limit(0);
+    for (int idle = 0; idle < 4; ) {
+        if (stif_loop(&netif))
+            idle = 0;
+        else
+            idle++;
+        sim_eth_step();
+    }
+
+    printf("%s probes: %lu sent, %lu out, avg %.1f max %lu frame times"
+           " (bulk dropped %lu)\n", marked ? "marked:   " : "unmarked: ",
+           lat.sent, lat.received,
+           lat.received ? (double) lat.total / lat.received : 0.,
+           lat.max, bulk_dropped);
+    print_loop_time();
+}
+
+int main(int argc, char *argv[])
+{
+    ip_addr_t ip_addr, net_mask, gw_addr;
+
+    parse_args(argc, argv);
+
+    if (opts.read_file != NULL && pcap_read(opts.read_file))
+        return 1;
+
+    if (opts.write_file != NULL) {
+        pcap_out = fopen(opts.write_file, "wb");
+        if (pcap_out == NULL) {
+            perror(opts.write_file);
+            return 1;
+        }
+        pcap_write_header(pcap_out);
+    }
+
+    IP4_ADDR(&ip_addr, 10, 0, 0, 2);
+    IP4_ADDR(&net_mask, 255, 255, 255, 0);
+    IP4_ADDR(&gw_addr, 10, 0, 0, 1);
+
+    sim_phy_set_pause(!opts.no_pause);
+
+    lwip_init();
+    netif_add(&netif, &ip_addr, &net_mask, &gw_addr, NULL, stif_init,
+              opts.full_stack ? ethernet_input : count_input);
+    netif_set_default(&netif);
+    netif_set_up(&netif);
+
+    if (opts.budget)
+        stif_set_rx_budget(opts.budget);
+    if (opts.copybreak >= 0)
+        stif_set_rx_copybreak(opts.copybreak);
+    if (opts.storm)
+        stif_set_rx_storm_rate(opts.storm, STORM_BURST);
+
+    if (opts.full_stack) {
+        struct udp_pcb *pcb = udp_new();
+        udp_bind(pcb, IP_ADDR_ANY, DISCARD_PORT);
+        udp_recv(pcb, discard_recv, NULL);
+    }
+
+    sim_eth_set_tx_handler(tx_frame, NULL);
+
+    //Let the PHY interrupt and the MDIO queue bring the link up
+    for (int i = 0; i < 100 && !netif_is_link_up(&netif); i++) {
+        stif_loop(&netif);
+        sim_eth_step();
+    }
+
+    if (!netif_is_link_up(&netif)) {
+        fprintf(stderr, "link did not come up\n");
+        return 1;
+    }
+
+    if (opts.pktgen)
+        return run_pktgen();
+
+    if (opts.latency) {
+        run_latency_pass(0);
+        run_latency_pass(1);
+        stif_stats_display();
+        return 0;
+    }
+
+    uint8_t gen[MAX_FRAME];
+    int gen_len = make_frame(gen, opts.size);
+
+    uint8_t bcast[MAX_FRAME];
+    memcpy(bcast, gen, gen_len);
+    memset(bcast, 0xFF, 6);
+    unsigned long bcast_offered = 0;
+
+    static uint8_t imix[IMIX_LEN][MAX_FRAME];
+    int imix_len[IMIX_LEN];
+    for (int i = 0; i < IMIX_LEN; i++)
+        imix_len[i] = make_frame(imix[i], imix_sizes[i]);
+
+    unsigned long offered = 0;
+    double start = now();
+    double last_tmr = start;
+    double fault_time = 0;
+    unsigned long fault_delivered = 0;
+
+    while (offered < opts.frames) {
+        if (opts.fault >= 0 && !fault_time && offered >= opts.frames / 2) {
+            fault_time = now();
+            fault_delivered = delivered;
+            stif_inject_fault(opts.fault, opts.fault_count);
+        }
+
+        //The link partner holds its frames back while it's paused
+        for (unsigned long i = 0; i < opts.burst && offered < opts.frames &&
+             !sim_eth_rx_paused(); i++, offered++)
+        {
+            if (opts.storm && (offered & 1)) {
+                sim_eth_rx(bcast, gen_len);
+                bcast_offered++;
+            } else if (trace.count) {
+                int idx = offered % trace.count;
+                sim_eth_rx(&trace.data[idx * MAX_FRAME], trace.len[idx]);
+            } else if (opts.mixed) {
+                int idx = offered % IMIX_LEN;
+                sim_eth_rx(imix[idx], imix_len[idx]);
+            } else {
+                sim_eth_rx(gen, gen_len);
+            }
+        }
+
+        timed_loop();
+        sim_eth_step();
+        run_tmr(&last_tmr);
+    }
+
+    //Drain whatever is still in the rings
+    for (int idle = 0; idle < 4; ) {
+        if (stif_loop(&netif))
+            idle = 0;
+        else
+            idle++;
+        sim_eth_step();
+    }
+    release_held();
+
+    double elapsed = now() - start;
+    stif_tmr();
+
+    const struct sim_eth_stats *s = sim_eth_get_stats();
+    printf("offered:   %lu frames in %.3f s (%.0f pps)\n", offered, elapsed,
+           offered / elapsed);
+    printf("delivered: %lu frames (%.0f pps)\n", delivered,
+           delivered / elapsed);
+    if (fault_time) {
+        printf("fault:     %lu %s, %.0f pps before and %.0f pps after\n",
+               opts.fault_count, fault_names[opts.fault],
+               fault_delivered / (fault_time - start),
+               (delivered - fault_delivered) / (start + elapsed - fault_time));
+    }
+    printf("mac:       rx %u missed %u filtered %u rbus %u pause %u\n",
+           s->rx_frames, s->rx_missed, s->rx_filtered, s->rx_ring_stalls,
+           s->tx_pause_frames);
+    printf("           tx %u tbus %u poll demands %u irqs %u\n",
+           s->tx_frames, s->tx_ring_stalls, s->tx_poll_demands, s->irqs);
+    print_loop_time();
+    if (opts.storm) {
+        const struct stif_stats *st = stif_get_stats();
+        printf("storm:     broadcast offered %lu delivered %lu dropped %u, "
+               "unicast offered %lu delivered %lu\n", bcast_offered,
+               delivered_bcast, st->rx_storm_dropped, offered - bcast_offered,
+               delivered - delivered_bcast);
+    }
+
+    stif_stats_display();
+    stats_display();
+
+    if (pcap_out != NULL)
+        fclose(pcap_out);
+
+    return 0;
+}
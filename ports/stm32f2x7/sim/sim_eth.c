@@ -0,0 +1,691 @@
+/****************************************************************//**
+ *
+ * @file sim_eth.c
+ *
+ * @brief    Behavioural model of the STM32F2x7 ethernet MAC and DMA
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "sim_eth.h"
+
+#include <devices/stm32f2xx.h>
+#include <stmlib/clock.h>
+#include <stmlib/int.h>
+#include <config.h>
+
+#include "stif_dma.h"
+#include "phy_ks8721.h"
+
+#include <string.h>
+#include <time.h>
+
+unsigned char sim_otp_hwaddr[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+unsigned char sim_unique_id[12];
+CoreDebug_Type sim_core_debug;
+
+static ETH_TypeDef regs;
+static DWT_Type dwt;
+
+//DMASR is write one to clear: a reserved bit is always set in the value
+//  the driver sees, so a write to the register is seen as it being clear.
+#define DMASR_MARK (1u << 31)
+
+//The poll demand and descriptor list address registers are reset to this
+//  after every access so writes by the driver can be detected.
+#define POLL_IDLE 0xFFFFFFFF
+
+#define MAX_FRAME 2048
+
+static struct {
+    int initialized;
+    uint32_t dmasr;
+    uint32_t rdlar;
+    uint32_t tdlar;
+    struct dma_desc *rx_desc;
+    struct dma_desc *tx_desc;
+    int tx_suspended;
+    int tx_limit;
+    int rx_wdt_pending;
+    int64_t rx_paused_until;
+    uint32_t rx_missed_pending;
+
+    sim_eth_tx_fn tx_fn;
+    void *tx_arg;
+
+    uint16_t phy[32];
+    uint8_t phy_irq_flags;
+    int phy_irq_line;
+
+    void (*handlers[SIM_NUM_IRQS])(void);
+    uint8_t enabled[SIM_NUM_IRQS];
+
+    int64_t ptp_offset;
+
+    struct sim_eth_stats stats;
+} sim;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void mac_reset(void)
+{
+    memset(&regs, 0, sizeof(regs));
+    regs.DMABMR = 0x00002100;
+    regs.DMASR = DMASR_MARK;
+    regs.DMATPDR = POLL_IDLE;
+    regs.DMARPDR = POLL_IDLE;
+    regs.DMARDLAR = POLL_IDLE;
+    regs.DMATDLAR = POLL_IDLE;
+
+    sim.dmasr = 0;
+    sim.rdlar = 0;
+    sim.tdlar = 0;
+    sim.rx_desc = NULL;
+    sim.tx_desc = NULL;
+    sim.tx_suspended = 0;
+    sim.rx_wdt_pending = 0;
+    sim.rx_paused_until = 0;
+}
+
+static void phy_reset(void)
+{
+    memset(sim.phy, 0, sizeof(sim.phy));
+    sim.phy[PHY_REG_BASIC_CTRL] = PHY_BCR_AUTO_NEG;
+    sim.phy[PHY_REG_BASIC_STATUS] = (PHY_BSR_100BASETX | PHY_BSR_FULLDPLX |
+                                     PHY_BSR_10BASET_HALFDPLX |
+                                     PHY_BSR_AUTO_NEG_ABILITY |
+                                     PHY_BSR_AUTO_NEG_COMPLETE |
+                                     PHY_BSR_LINK_UP);
+    sim.phy[PHY_REG_ID1] = PHY_IDENTIFIER1;
+    sim.phy[PHY_REG_ID2] = PHY_IDENTIFIER2;
+    sim.phy[PHY_REG_AUTO_NEG_AD] = 0x01E1;
+    sim.phy[PHY_REG_LINK_PARTNER] = (PHY_LINK_PARTNER_100BASETX |
+                                     PHY_LINK_PARTNER_FULLDPLX |
+                                     PHY_LINK_PARTNER_10BASET_HALFDPLX |
+                                     PHY_LINK_PARTNER_SYM_PAUSE | 1);
+    sim.phy[PHY_REG_CONTROLLER] = (PHY_CTRL_MODE_100BASETX_FULLDUPLX |
+                                   PHY_CTRL_AUTONEG_COMPLETE |
+                                   PHY_CTRL_ENABLE_PAUSE);
+}
+
+static void init(void)
+{
+    mac_reset();
+    phy_reset();
+    sim.initialized = 1;
+}
+
+static void set_status(uint32_t bits)
+{
+    sim.dmasr |= bits;
+    regs.DMASR = sim.dmasr | DMASR_MARK;
+}
+
+static int phy_read(int reg)
+{
+    int value = sim.phy[reg];
+
+    //The interrupt flags are cleared on read
+    if (reg == PHY_REG_INTERRUPT) {
+        value |= sim.phy_irq_flags;
+        sim.phy_irq_flags = 0;
+    }
+
+    return value;
+}
+
+static void phy_write(int reg, int value)
+{
+    switch (reg) {
+    case PHY_REG_INTERRUPT:
+        sim.phy[reg] = value & 0xFF00;
+        break;
+    case PHY_REG_BASIC_CTRL:
+        //Negotiation completes immediately
+        if (value & PHY_BCR_RESTART_AUTO_NEG)
+            sim.phy_irq_flags |= PHY_IF_LINK_UP;
+        sim.phy[reg] = value & ~(PHY_BCR_RESET | PHY_BCR_RESTART_AUTO_NEG);
+        break;
+    case PHY_REG_BASIC_STATUS:
+    case PHY_REG_ID1:
+    case PHY_REG_ID2:
+        break;
+    default:
+        sim.phy[reg] = value;
+    }
+}
+
+//The link partner stops sending for the requested number of quanta (512
+//  bit times), or resumes straight away on a zero quanta PAUSE
+static void send_pause(void)
+{
+    regs.MACFCR &= ~ETH_MACFCR_FCBBPA;
+
+    if (!(regs.MACFCR & ETH_MACFCR_TFCE))
+        return;
+
+    uint32_t quanta = (regs.MACFCR & ETH_MACFCR_PT) >> 16;
+    int64_t bit_ns = (regs.MACCR & ETH_MACCR_FES) ? 10 : 100;
+
+    sim.stats.tx_pause_frames++;
+    if (sim.phy[PHY_REG_LINK_PARTNER] & PHY_LINK_PARTNER_SYM_PAUSE)
+        sim.rx_paused_until = quanta ? now_ns() + quanta * 512 * bit_ns : 0;
+}
+
+static void ptp_time(uint32_t *sec, uint32_t *nsec)
+{
+    int64_t t = now_ns() + sim.ptp_offset;
+    *sec = t / 1000000000;
+    *nsec = t % 1000000000;
+}
+
+//Emulates the side effects of the previous register accesses, this runs
+//  before every access the driver makes.
+static void service(void)
+{
+    if (!sim.initialized)
+        init();
+
+    if (regs.DMABMR & ETH_DMABMR_SR)
+        mac_reset();
+
+    uint32_t sr = regs.DMASR;
+    if (!(sr & DMASR_MARK)) {
+        sim.dmasr &= ~sr;
+        regs.DMASR = sim.dmasr | DMASR_MARK;
+    }
+
+    if (regs.MACMIIAR & ETH_MACMIIAR_MB) {
+        int reg = (regs.MACMIIAR & ETH_MACMIIAR_MR) >> 6;
+        if (regs.MACMIIAR & ETH_MACMIIAR_MW)
+            phy_write(reg, regs.MACMIIDR & 0xFFFF);
+        else
+            regs.MACMIIDR = phy_read(reg);
+        regs.MACMIIAR &= ~ETH_MACMIIAR_MB;
+    }
+
+    if (regs.MACFCR & ETH_MACFCR_FCBBPA)
+        send_pause();
+
+    if (regs.DMATPDR != POLL_IDLE) {
+        sim.stats.tx_poll_demands++;
+        sim.tx_suspended = 0;
+        regs.DMATPDR = POLL_IDLE;
+    }
+
+    //Reception resumes by itself when the next frame arrives
+    regs.DMARPDR = POLL_IDLE;
+
+    //Writing a list address restarts the DMA at the head of the list
+    if (regs.DMARDLAR != POLL_IDLE) {
+        sim.rdlar = regs.DMARDLAR;
+        sim.rx_desc = (struct dma_desc *) (uintptr_t) sim.rdlar;
+        regs.DMARDLAR = POLL_IDLE;
+    }
+
+    if (regs.DMATDLAR != POLL_IDLE) {
+        sim.tdlar = regs.DMATDLAR;
+        sim.tx_desc = (struct dma_desc *) (uintptr_t) sim.tdlar;
+        sim.tx_suspended = 0;
+        regs.DMATDLAR = POLL_IDLE;
+    }
+
+    regs.DMAOMR &= ~ETH_DMAOMR_FTF;
+
+    if (regs.PTPTSCR & ETH_PTPTSCR_TSSTI) {
+        sim.ptp_offset = ((int64_t) regs.PTPTSHUR * 1000000000 +
+                          (regs.PTPTSLUR & ETH_PTPTSLUR_TSUSS)) - now_ns();
+    }
+    regs.PTPTSCR &= ~(ETH_PTPTSCR_TSSTI | ETH_PTPTSCR_TSSTU |
+                      ETH_PTPTSCR_TSARU);
+
+    if (regs.PTPTSCR & ETH_PTPTSCR_TSE) {
+        uint32_t sec, nsec;
+        ptp_time(&sec, &nsec);
+        regs.PTPTSHR = sec;
+        regs.PTPTSLR = nsec;
+    }
+}
+
+ETH_TypeDef *sim_eth_regs(void)
+{
+    service();
+    return &regs;
+}
+
+DWT_Type *sim_dwt_regs(void)
+{
+    //Counts at HCLK in host time
+    if (dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk)
+        dwt.CYCCNT = (uint64_t) now_ns() * (SIM_HCLK / 1000000) / 1000;
+
+    return &dwt;
+}
+
+void int_register(IRQn_Type irq, void (*handler)(void))
+{
+    sim.handlers[irq] = handler;
+}
+
+void int_enable(IRQn_Type irq)
+{
+    sim.enabled[irq] = 1;
+}
+
+void int_disable(IRQn_Type irq)
+{
+    sim.enabled[irq] = 0;
+}
+
+static struct dma_desc *desc_skip(struct dma_desc *desc)
+{
+    //The skip length is counted from the end of the 8 word descriptor
+    int dsl = (regs.DMABMR & ETH_DMABMR_DSL) >> 2;
+    return (struct dma_desc *) ((uint8_t *) desc + 32 + dsl * 4);
+}
+
+static struct dma_desc *rx_next(struct dma_desc *desc)
+{
+    if (desc->ControlBufferSize & ETH_DMARxDesc_RCH)
+        return desc->Buffer2NextDescAddr;
+    if (desc->ControlBufferSize & ETH_DMARxDesc_RER)
+        return (struct dma_desc *) (uintptr_t) sim.rdlar;
+    return desc_skip(desc);
+}
+
+static struct dma_desc *tx_next(struct dma_desc *desc)
+{
+    if (desc->Status & ETH_DMATxDesc_TCH)
+        return desc->Buffer2NextDescAddr;
+    if (desc->Status & ETH_DMATxDesc_TER)
+        return (struct dma_desc *) (uintptr_t) sim.tdlar;
+    return desc_skip(desc);
+}
+
+static int hash_bucket(const uint8_t *addr)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (int i = 0; i < 6; i++) {
+        crc ^= addr[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+
+    crc = ~crc;
+    int bucket = 0;
+    for (int bit = 0; bit < 6; bit++)
+        bucket = (bucket << 1) | ((crc >> bit) & 1);
+
+    return bucket;
+}
+
+static int addr_match(const uint8_t *addr, uint32_t high, uint32_t low)
+{
+    return (addr[0] == (low & 0xFF) && addr[1] == ((low >> 8) & 0xFF) &&
+            addr[2] == ((low >> 16) & 0xFF) && addr[3] == (low >> 24) &&
+            addr[4] == (high & 0xFF) && addr[5] == ((high >> 8) & 0xFF));
+}
+
+static int perfect_match(const uint8_t *addr)
+{
+    __IO uint32_t *mach = &regs.MACA1HR;
+    __IO uint32_t *macl = &regs.MACA1LR;
+
+    for (int slot = 0; slot < 3; slot++)
+        if ((mach[slot*2] & ETH_MACA1HR_AE) &&
+            addr_match(addr, mach[slot*2], macl[slot*2]))
+            return 1;
+
+    return addr_match(addr, regs.MACA0HR, regs.MACA0LR);
+}
+
+static int hash_match(const uint8_t *addr)
+{
+    int bucket = hash_bucket(addr);
+    uint32_t table = (bucket & 0x20) ? regs.MACHTHR : regs.MACHTLR;
+    return (table >> (bucket & 0x1F)) & 1;
+}
+
+static int is_pause(const uint8_t *frame)
+{
+    return frame[12] == 0x88 && frame[13] == 0x08 &&
+        frame[14] == 0x00 && frame[15] == 0x01;
+}
+
+static int address_filter(const uint8_t *frame)
+{
+    uint32_t ffr = regs.MACFFR;
+
+    if (ffr & (ETH_MACFFR_RA | ETH_MACFFR_PM))
+        return 1;
+
+    if (memcmp(frame, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) == 0)
+        return !(ffr & ETH_MACFFR_BFD);
+
+    if (perfect_match(frame))
+        return 1;
+
+    if (frame[0] & 1) {
+        if (ffr & ETH_MACFFR_PAM)
+            return 1;
+        return (ffr & ETH_MACFFR_HM) && hash_match(frame);
+    }
+
+    return (ffr & ETH_MACFFR_HU) && hash_match(frame);
+}
+
+static int rx_desc_size(struct dma_desc *desc)
+{
+    int size = desc->ControlBufferSize & ETH_DMARxDesc_RBS1;
+    if (!(desc->ControlBufferSize & ETH_DMARxDesc_RCH))
+        size += (desc->ControlBufferSize & ETH_DMARxDesc_RBS2) >> 16;
+    return size;
+}
+
+static void raise_interrupts(void);
+
+static void rx_missed(void)
+{
+    sim.stats.rx_missed++;
+    sim.rx_missed_pending++;
+}
+
+int sim_eth_rx(const void *frame, int len)
+{
+    service();
+
+    if (!(regs.MACCR & ETH_MACCR_RE) || !(regs.DMAOMR & ETH_DMAOMR_SR) ||
+        sim.rx_desc == NULL)
+    {
+        rx_missed();
+        return 0;
+    }
+
+    if (len + 4 > MAX_FRAME)
+        return 0;
+
+    if (is_pause(frame)) {
+        //Forwarded to the driver only with PCF set to forward all
+        sim.stats.rx_pause_frames++;
+        if ((regs.MACFFR & ETH_MACFFR_PCF) != ETH_MACFFR_PCF_ForwardAll)
+            return 0;
+    } else if (!address_filter(frame)) {
+        sim.stats.rx_filtered++;
+        return 0;
+    }
+
+    //The frame is dropped if it doesn't fit in the descriptors the DMA
+    //  owns (the MAC's FIFO isn't modeled)
+    uint8_t data[MAX_FRAME];
+    int total = len + 4;
+    memcpy(data, frame, len);
+    memset(&data[len], 0, 4);
+
+    struct dma_desc *desc = sim.rx_desc;
+    for (int room = 0; room < total; desc = rx_next(desc)) {
+        if (!(desc->Status & ETH_DMARxDesc_OWN)) {
+            if (!(sim.dmasr & ETH_DMASR_RBUS))
+                sim.stats.rx_ring_stalls++;
+            set_status(ETH_DMASR_RBUS | ETH_DMASR_AIS);
+            rx_missed();
+            return 0;
+        }
+        room += rx_desc_size(desc);
+    }
+
+    int offset = 0;
+    uint32_t status = ETH_DMARxDesc_FS;
+    desc = sim.rx_desc;
+
+    for (;;) {
+        int size = desc->ControlBufferSize & ETH_DMARxDesc_RBS1;
+        if (size > total - offset)
+            size = total - offset;
+        memcpy(desc->Buffer1Addr, &data[offset], size);
+        offset += size;
+
+        if (!(desc->ControlBufferSize & ETH_DMARxDesc_RCH) && offset < total) {
+            size = (desc->ControlBufferSize & ETH_DMARxDesc_RBS2) >> 16;
+            if (size > total - offset)
+                size = total - offset;
+            memcpy(desc->Buffer2NextDescAddr, &data[offset], size);
+            offset += size;
+        }
+
+        desc->ExtendedStatus = 0;
+
+        if (offset == total)
+            break;
+
+        desc->Status = status;
+        status = 0;
+        desc = rx_next(desc);
+    }
+
+    status |= ETH_DMARxDesc_LS | (total << 16);
+    if (regs.PTPTSCR & ETH_PTPTSCR_TSE) {
+        ptp_time(&desc->TimeStampHigh, &desc->TimeStampLow);
+        status |= ETH_DMARxDesc_TSV;
+    }
+    desc->Status = status;
+
+    //Interrupts for descriptors with DIC set wait for the watchdog, which
+    //  expires at the next step.
+    sim.rx_desc = rx_next(desc);
+    sim.stats.rx_frames++;
+    sim.stats.rx_bytes += len;
+
+    //Otherwise the interrupt preempts whatever the driver was doing
+    if (desc->ControlBufferSize & ETH_DMARxDesc_DIC) {
+        sim.rx_wdt_pending = 1;
+    } else {
+        set_status(ETH_DMASR_RS | ETH_DMASR_NIS);
+        raise_interrupts();
+    }
+
+    return 1;
+}
+
+static int tx_frame(void)
+{
+    struct dma_desc *desc = sim.tx_desc;
+
+    //Only whole frames are sent, the driver hands over the first
+    //  descriptor last.
+    for (;;) {
+        if (!(desc->Status & ETH_DMATxDesc_OWN)) {
+            set_status(ETH_DMASR_TBUS | ETH_DMASR_NIS);
+            sim.tx_suspended = 1;
+            sim.stats.tx_ring_stalls++;
+            return 0;
+        }
+
+        if (desc->Status & ETH_DMATxDesc_LS)
+            break;
+
+        desc = tx_next(desc);
+    }
+
+    static uint8_t frame[MAX_FRAME];
+    int len = 0;
+    int ttse = sim.tx_desc->Status & ETH_DMATxDesc_TTSE;
+
+    for (desc = sim.tx_desc; ; desc = tx_next(desc)) {
+        int size1 = desc->ControlBufferSize & 0x1FFF;
+        int size2 = 0;
+        if (!(desc->Status & ETH_DMATxDesc_TCH))
+            size2 = (desc->ControlBufferSize >> 16) & 0x1FFF;
+
+        if (len + size1 + size2 <= MAX_FRAME) {
+            memcpy(&frame[len], desc->Buffer1Addr, size1);
+            if (size2)
+                memcpy(&frame[len + size1], desc->Buffer2NextDescAddr, size2);
+        }
+        len += size1 + size2;
+
+        uint32_t status = desc->Status & ~ETH_DMATxDesc_OWN;
+        if (status & ETH_DMATxDesc_LS) {
+            if (ttse) {
+                ptp_time(&desc->TimeStampHigh, &desc->TimeStampLow);
+                status |= ETH_DMATxDesc_TTSS;
+            }
+            if (status & ETH_DMATxDesc_IC)
+                set_status(ETH_DMASR_TS | ETH_DMASR_NIS);
+        }
+        desc->Status = status;
+
+        if (status & ETH_DMATxDesc_LS)
+            break;
+    }
+
+    sim.tx_desc = tx_next(desc);
+    sim.stats.tx_frames++;
+    sim.stats.tx_bytes += len;
+
+    if (len > MAX_FRAME)
+        return 1;
+
+    //In loopback the frame comes straight back in instead of going out
+    if (regs.MACCR & ETH_MACCR_LM)
+        sim_eth_rx(frame, len);
+    else if (sim.tx_fn != NULL)
+        sim.tx_fn(frame, len, sim.tx_arg);
+
+    return 1;
+}
+
+static void tx_run(void)
+{
+    if (!(regs.DMAOMR & ETH_DMAOMR_ST) || sim.tx_desc == NULL)
+        return;
+
+    for (int sent = 0; !sim.tx_limit || sent < sim.tx_limit; sent++)
+        if (sim.tx_suspended || !tx_frame())
+            break;
+}
+
+static void raise_interrupts(void)
+{
+    uint32_t pending = sim.dmasr & regs.DMAIER;
+    if ((pending & (ETH_DMASR_NIS | ETH_DMASR_AIS)) &&
+        (pending & ~(ETH_DMASR_NIS | ETH_DMASR_AIS)) &&
+        sim.enabled[ETH_IRQn] && sim.handlers[ETH_IRQn] != NULL)
+    {
+        sim.stats.irqs++;
+        sim.handlers[ETH_IRQn]();
+    }
+
+    //The PHY interrupt is edge triggered
+    int line = (sim.phy_irq_flags & (sim.phy[PHY_REG_INTERRUPT] >> 8)) != 0;
+    if (line && !sim.phy_irq_line && sim.enabled[ETH_RMII_MDINT_IRQ] &&
+        sim.handlers[ETH_RMII_MDINT_IRQ] != NULL)
+        sim.handlers[ETH_RMII_MDINT_IRQ]();
+    sim.phy_irq_line = line;
+}
+
+void sim_eth_step(void)
+{
+    service();
+    tx_run();
+
+    if (sim.rx_wdt_pending) {
+        sim.rx_wdt_pending = 0;
+        set_status(ETH_DMASR_RS | ETH_DMASR_NIS);
+    }
+
+    raise_interrupts();
+}
+
+//The FIFO isn't modelled so there are never any overflows to report
+uint32_t sim_eth_read_mfbocr(void)
+{
+    uint32_t missed = sim.rx_missed_pending;
+
+    if (missed > ETH_DMAMFBOCR_MFC)
+        regs.DMAMFBOCR_latch[0] = ETH_DMAMFBOCR_MFC | ETH_DMAMFBOCR_OMFC;
+    else
+        regs.DMAMFBOCR_latch[0] = missed;
+    sim.rx_missed_pending = 0;
+
+    return 0;
+}
+
+void sim_eth_set_tx_handler(sim_eth_tx_fn fn, void *arg)
+{
+    sim.tx_fn = fn;
+    sim.tx_arg = arg;
+}
+
+void sim_eth_set_tx_limit(int frames)
+{
+    sim.tx_limit = frames;
+}
+
+void sim_phy_set_link(int up)
+{
+    if (!sim.initialized)
+        init();
+
+    if (up) {
+        sim.phy[PHY_REG_BASIC_STATUS] |= PHY_BSR_LINK_UP;
+        sim.phy_irq_flags |= PHY_IF_LINK_UP;
+    } else {
+        sim.phy[PHY_REG_BASIC_STATUS] &= ~PHY_BSR_LINK_UP;
+        sim.phy_irq_flags |= PHY_IF_LINK_DOWN;
+    }
+}
+
+void sim_phy_set_pause(int enable)
+{
+    if (!sim.initialized)
+        init();
+
+    if (enable)
+        sim.phy[PHY_REG_LINK_PARTNER] |= PHY_LINK_PARTNER_SYM_PAUSE;
+    else
+        sim.phy[PHY_REG_LINK_PARTNER] &= ~PHY_LINK_PARTNER_SYM_PAUSE;
+}
+
+int sim_eth_rx_paused(void)
+{
+    return sim.rx_paused_until && now_ns() < sim.rx_paused_until;
+}
+
+const struct sim_eth_stats *sim_eth_get_stats(void)
+{
+    return &sim.stats;
+}
@@ -0,0 +1,87 @@
+/****************************************************************//**
+ *
+ * @file sim_eth.h
+ *
+ * @brief    Behavioural model of the STM32F2x7 ethernet MAC and DMA
+ *
+ * Copyright (c) 2026 The lwip_contrib contributors
+ * All rights reserved.
+ *
+ ********************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification,are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __SIM_ETH_H__
+#define __SIM_ETH_H__
+
+#include <stdint.h>
+
+struct sim_eth_stats {
+    uint32_t rx_frames;
+    uint64_t rx_bytes;
+    uint32_t rx_missed;        //No free descriptors (or reception stopped)
+    uint32_t rx_filtered;      //Rejected by the address filter
+    uint32_t rx_pause_frames;
+    uint32_t tx_pause_frames;  //Sent by the driver to the link partner
+    uint32_t rx_ring_stalls;   //Times the ring ran dry (RBUS)
+    uint32_t tx_frames;
+    uint64_t tx_bytes;
+    uint32_t tx_ring_stalls;   //Times the DMA found the ring empty (TBUS)
+    uint32_t tx_poll_demands;  //Writes to DMATPDR
+    uint32_t irqs;
+};
+
+typedef void (*sim_eth_tx_fn)(const uint8_t *frame, int len, void *arg);
+
+//Offer a frame (without the CRC) to the MAC, as if it just arrived from
+//  the wire. Returns 1 if it was written into the receive ring.
+int sim_eth_rx(const void *frame, int len);
+
+//Run the transmit DMA and deliver any pending interrupts. This should be
+//  called after every stif_loop.
+void sim_eth_step(void);
+
+//Called for every frame the transmit DMA sends
+void sim_eth_set_tx_handler(sim_eth_tx_fn fn, void *arg);
+
+//Maximum frames sent per sim_eth_step, zero is unlimited
+void sim_eth_set_tx_limit(int frames);
+
+void sim_phy_set_link(int up);
+
+//Whether the link partner advertises (symmetric) PAUSE support. This is
+//  read when the link comes up.
+void sim_phy_set_pause(int enable);
+
+//Whether the link partner is holding off after a PAUSE frame from the
+//  driver. The caller models the link partner, so it shouldn't offer
+//  frames while this is set.
+int sim_eth_rx_paused(void);
+
+const struct sim_eth_stats *sim_eth_get_stats(void);
+
+#endif